@@ -0,0 +1,199 @@
+/* blip_bench.c: Microbenchmark for the audio synthesis and read path
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Times the two halves of the audio cost of a frame in
+   fuse/sound/blipbuffer.c: adding amplitude changes to the buffers with
+   blip_synth_update(), and filtering them into samples at the end of the
+   frame. The buffers and synths are set up as sound.c does for a 128K
+   with ABC stereo at 44.1kHz, and fed with the changes from some typical
+   kinds of sound. Both ways of reading stereo are timed, and each
+   workload's output is checksummed so that they, and different versions
+   of blipbuffer.c, can be checked against each other */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sound/blipbuffer.h"
+
+#define CLOCK_RATE 3546900
+#define SAMPLE_RATE 44100
+#define TSTATES_PER_FRAME 70908
+#define FRAMES 5000
+
+#define AMPL_AY_TONE ( 24 * 256 )
+
+static Blip_Buffer *left_buf, *right_buf;
+static Blip_Synth *a_synth, *b_synth, *c_synth, *b_synth_r;
+static blip_sample_t samples[ 2 * ( SAMPLE_RATE / 50 + 1 ) ];
+
+static double
+now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Blip_Synth*
+synth_new( Blip_Buffer *buf )
+{
+  Blip_Synth *synth = new_Blip_Synth();
+
+  blip_synth_set_volume( synth, 1.0 );
+  blip_synth_set_output( synth, buf );
+  blip_synth_set_treble_eq( synth, -37.0 );
+
+  return synth;
+}
+
+static Blip_Buffer*
+buffer_new( void )
+{
+  Blip_Buffer *buf = new_Blip_Buffer();
+
+  blip_buffer_set_clock_rate( buf, CLOCK_RATE );
+  blip_buffer_set_sample_rate( buf, SAMPLE_RATE, 1000 );
+  blip_buffer_set_bass_freq( buf, 200 );
+
+  return buf;
+}
+
+/* A square wave on `synth' flipping every `period' T-states */
+static void
+square( Blip_Synth *synth, Blip_Synth *synth_r, blip_time_t *next,
+        blip_time_t period, int *high, int level )
+{
+  for( ; *next < TSTATES_PER_FRAME; *next += period ) {
+    int amp = ( *high = !*high ) ? level : -level;
+    blip_synth_update( synth, *next, amp );
+    if( synth_r ) blip_synth_update( synth_r, *next, amp );
+  }
+  *next -= TSTATES_PER_FRAME;
+}
+
+typedef struct workload_t {
+  const char *name;
+  blip_time_t periods[3];	/* in T-states; 0 for silence */
+} workload_t;
+
+static const workload_t workloads[] = {
+  /* three tones around middle C */
+  { "AY music", { 6784, 5376, 4544 } },
+  /* a tone, a fast arpeggio and noise changing every 64 T-states */
+  { "AY noise", { 3392, 448, 64 } },
+  /* one channel being used as a 4-bit DAC at ~15kHz */
+  { "AY samples", { 0, 224, 0 } },
+};
+
+static unsigned long
+run( const workload_t *workload, int fused, double *update_time,
+     double *read_time )
+{
+  blip_time_t next[3] = { 0, 0, 0 };
+  int high[3] = { 0, 0, 0 };
+  unsigned long checksum = 0;
+  double start;
+  long count, i;
+  int frame;
+
+  /* Start from silence */
+  blip_buffer_clear( left_buf, 1 );
+  blip_buffer_clear( right_buf, 1 );
+  blip_synth_set_output( a_synth, left_buf );
+  blip_synth_set_output( b_synth, left_buf );
+  blip_synth_set_output( b_synth_r, right_buf );
+  blip_synth_set_output( c_synth, right_buf );
+
+  *update_time = *read_time = 0;
+
+  for( frame = 0; frame < FRAMES; frame++ ) {
+    start = now();
+    if( workload->periods[0] )
+      square( a_synth, NULL, &next[0], workload->periods[0], &high[0],
+              AMPL_AY_TONE );
+    if( workload->periods[1] )
+      square( b_synth, b_synth_r, &next[1], workload->periods[1], &high[1],
+              AMPL_AY_TONE / 2 );
+    if( workload->periods[2] )
+      square( c_synth, NULL, &next[2], workload->periods[2], &high[2],
+              AMPL_AY_TONE );
+    *update_time += now() - start;
+
+    start = now();
+    blip_buffer_end_frame( left_buf, TSTATES_PER_FRAME );
+    blip_buffer_end_frame( right_buf, TSTATES_PER_FRAME );
+    if( fused ) {
+      count = blip_buffer_read_stereo_samples( left_buf, right_buf, samples,
+                                               SAMPLE_RATE / 50 + 1 );
+    } else {
+      count = blip_buffer_read_samples( left_buf, samples,
+                                        SAMPLE_RATE / 50 + 1, 1 );
+      blip_buffer_read_samples( right_buf, samples + 1, count, 1 );
+    }
+    *read_time += now() - start;
+
+    for( i = 0; i < 2 * count; i++ )
+      checksum = checksum * 31 + (unsigned short)samples[i];
+  }
+
+  return checksum;
+}
+
+int
+main( void )
+{
+  size_t i;
+
+  left_buf = buffer_new();
+  right_buf = buffer_new();
+
+  a_synth = synth_new( left_buf );
+  b_synth = synth_new( left_buf );
+  b_synth_r = synth_new( right_buf );
+  c_synth = synth_new( right_buf );
+
+  for( i = 0; i < sizeof( workloads ) / sizeof( workloads[0] ); i++ ) {
+    double update_time, read_time, fused_update_time, fused_read_time;
+    unsigned long checksum, fused_checksum;
+
+    checksum = run( &workloads[i], 0, &update_time, &read_time );
+    fused_checksum = run( &workloads[i], 1, &fused_update_time,
+                          &fused_read_time );
+
+    printf( "%s:\n", workloads[i].name );
+    printf( "  updates          %8.2f us/frame\n",
+            update_time * 1e6 / FRAMES );
+    printf( "  read, two passes %8.2f us/frame  checksum %08lx\n",
+            read_time * 1e6 / FRAMES, checksum & 0xffffffff );
+    printf( "  read, one pass   %8.2f us/frame  checksum %08lx\n",
+            fused_read_time * 1e6 / FRAMES, fused_checksum & 0xffffffff );
+  }
+
+  delete_Blip_Synth( &a_synth );
+  delete_Blip_Synth( &b_synth );
+  delete_Blip_Synth( &b_synth_r );
+  delete_Blip_Synth( &c_synth );
+  delete_Blip_Buffer( &left_buf );
+  delete_Blip_Buffer( &right_buf );
+
+  return 0;
+}
@@ -0,0 +1,144 @@
+/* event_bench.c: Microbenchmark for the event scheduler
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Drives fuse/event.c the way the emulation loop does: a number of
+   self-rescheduling event streams (tape edges, FDC index pulses and the
+   like), a frame end every 69888 T-states and, every so often, one
+   stream being cancelled with event_remove_type() and restarted. Only
+   event.c and the allocator are linked in, so the same program can be
+   built against older versions of the scheduler for comparison */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libspectrum.h>
+
+#include "compat.h"
+#include "event.h"
+#include "machine.h"
+
+#define FRAME_LENGTH 69888
+
+/* Pieces of the emulator event.c needs */
+libspectrum_dword tstates;
+fuse_machine_info *machine_current;
+
+char*
+utils_safe_strdup( const char *src )
+{
+  char *dest = NULL;
+  if( src ) {
+    dest = libspectrum_malloc( strlen( src ) + 1 );
+    strcpy( dest, src );
+  }
+  return dest;
+}
+
+static libspectrum_dword seed = 1;
+static unsigned long fired;
+
+static libspectrum_dword
+next_random( void )
+{
+  seed = seed * 1103515245 + 12345;
+  return ( seed >> 8 ) & 0xffff;
+}
+
+/* Each event comes back between 200 and ~4000 T-states later, about the
+   spacing of tape edges */
+static void
+stream_event( libspectrum_dword event_tstates, int type,
+              void *user_data GCC_UNUSED )
+{
+  fired++;
+  event_add( event_tstates + 200 + ( next_random() & 0xeff ), type );
+}
+
+static double
+now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run( int streams, int frames )
+{
+  int *types = malloc( streams * sizeof( *types ) );
+  double start, elapsed;
+  int i, frame;
+
+  for( i = 0; i < streams; i++ ) {
+    types[i] = event_register( stream_event, "Benchmark" );
+    event_add( next_random() & 0xfff, types[i] );
+  }
+
+  fired = 0;
+  start = now();
+
+  for( frame = 0; frame < frames; frame++ ) {
+
+    /* Cancel and restart one stream, as the FDCs do with their timeouts */
+    if( frame % 4 == 0 ) {
+      int type = types[ next_random() % streams ];
+      event_remove_type( type );
+      event_add( tstates + ( next_random() & 0xfff ), type );
+    }
+
+    /* As z80_do_opcodes() does, jump straight to each event */
+    while( event_next_event < FRAME_LENGTH ) {
+      tstates = event_next_event;
+      event_do_events();
+    }
+
+    tstates = FRAME_LENGTH;
+    event_frame( FRAME_LENGTH );
+    tstates -= FRAME_LENGTH;
+  }
+
+  elapsed = now() - start;
+
+  printf( "%4d streams: %10.0f events/sec (%lu events in %.3fs)\n",
+          streams, fired / elapsed, fired, elapsed );
+
+  event_reset();
+  free( types );
+}
+
+int
+main( int argc, char **argv )
+{
+  static const int streams[] = { 4, 16, 64, 256 };
+  int frames = argc > 1 ? atoi( argv[1] ) : 2000;
+  size_t i;
+
+  event_init();
+
+  for( i = 0; i < sizeof( streams ) / sizeof( streams[0] ); i++ )
+    run( streams[i], frames );
+
+  event_end();
+
+  return 0;
+}
@@ -0,0 +1,296 @@
+/* frontend.c: Minimal libretro frontend for the benchmarks
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#include <config.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frontend.h"
+
+#define MAX_OPTIONS 32
+#define MAX_COUNTERS 16
+
+static struct {
+  const char *key;
+  const char *value;
+} options[ MAX_OPTIONS ];
+static size_t option_count = 0;
+
+static struct retro_perf_counter *counters[ MAX_COUNTERS ];
+static size_t counter_count = 0;
+
+static const char *system_directory = NULL;
+static int fast_forwarding = 0;
+
+static retro_video_refresh_t frontend_video;
+static retro_audio_sample_batch_t frontend_audio;
+
+retro_perf_tick_t
+frontend_time( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (retro_perf_tick_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static retro_time_t
+frontend_get_time_usec( void )
+{
+  return frontend_time() / 1000;
+}
+
+static uint64_t
+frontend_get_cpu_features( void )
+{
+  return 0;
+}
+
+static void
+frontend_perf_register( struct retro_perf_counter *counter )
+{
+  if( counter->registered ) return;
+
+  if( counter_count < MAX_COUNTERS ) counters[ counter_count++ ] = counter;
+  counter->registered = true;
+}
+
+static void
+frontend_perf_start( struct retro_perf_counter *counter )
+{
+  counter->start = frontend_time();
+}
+
+static void
+frontend_perf_stop( struct retro_perf_counter *counter )
+{
+  counter->total += frontend_time() - counter->start;
+  counter->call_cnt++;
+}
+
+static void
+frontend_perf_log( void )
+{
+}
+
+const struct retro_perf_counter*
+frontend_counter( const char *ident )
+{
+  size_t i;
+
+  for( i = 0; i < counter_count; i++ )
+    if( !strcmp( counters[i]->ident, ident ) ) return counters[i];
+
+  return NULL;
+}
+
+void
+frontend_counters_reset( void )
+{
+  size_t i;
+
+  for( i = 0; i < counter_count; i++ ) {
+    counters[i]->total = 0;
+    counters[i]->call_cnt = 0;
+  }
+}
+
+int
+frontend_option( const char *key, const char *value )
+{
+  if( option_count == MAX_OPTIONS ) {
+    fprintf( stderr, "too many core options\n" );
+    return 1;
+  }
+
+  options[ option_count ].key = key;
+  options[ option_count ].value = value;
+  option_count++;
+
+  return 0;
+}
+
+void
+frontend_system_directory( const char *directory )
+{
+  system_directory = directory;
+}
+
+void
+frontend_fast_forward( int fast_forward )
+{
+  fast_forwarding = fast_forward;
+}
+
+static void
+frontend_log( enum retro_log_level level, const char *format, ... )
+{
+  va_list ap;
+
+  if( level < RETRO_LOG_WARN ) return;
+
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+}
+
+static bool
+frontend_environment( unsigned cmd, void *data )
+{
+  switch( cmd ) {
+
+  case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+    ( (struct retro_log_callback*)data )->log = frontend_log;
+    return true;
+
+  case RETRO_ENVIRONMENT_GET_PERF_INTERFACE:
+    {
+      struct retro_perf_callback *perf = data;
+
+      perf->get_time_usec = frontend_get_time_usec;
+      perf->get_cpu_features = frontend_get_cpu_features;
+      perf->get_perf_counter = frontend_time;
+      perf->perf_register = frontend_perf_register;
+      perf->perf_start = frontend_perf_start;
+      perf->perf_stop = frontend_perf_stop;
+      perf->perf_log = frontend_perf_log;
+    }
+    return true;
+
+  case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+    return true;
+
+  case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+    *(bool*)data = true;
+    return true;
+
+  case RETRO_ENVIRONMENT_GET_VARIABLE:
+    {
+      struct retro_variable *variable = data;
+      size_t i;
+
+      for( i = 0; i < option_count; i++ ) {
+        if( !strcmp( options[i].key, variable->key ) ) {
+          variable->value = options[i].value;
+          return true;
+        }
+      }
+    }
+    return false;
+
+  case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+    *(const char**)data = system_directory;
+    return system_directory != NULL;
+
+  case RETRO_ENVIRONMENT_GET_FASTFORWARDING:
+    *(bool*)data = fast_forwarding;
+    return true;
+
+  case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+    *(bool*)data = false;
+    return true;
+
+  default:
+    return false;
+
+  }
+}
+
+static void
+frontend_video_refresh( const void *data, unsigned width, unsigned height,
+                        size_t pitch )
+{
+  if( frontend_video ) frontend_video( data, width, height, pitch );
+}
+
+static void
+frontend_audio_sample( int16_t left, int16_t right )
+{
+}
+
+static size_t
+frontend_audio_sample_batch( const int16_t *data, size_t frames )
+{
+  return frontend_audio ? frontend_audio( data, frames ) : frames;
+}
+
+static void
+frontend_input_poll( void )
+{
+}
+
+static int16_t
+frontend_input_state( unsigned port, unsigned device, unsigned index,
+                      unsigned id )
+{
+  return 0;
+}
+
+void
+frontend_init( retro_video_refresh_t video, retro_audio_sample_batch_t audio )
+{
+  frontend_video = video;
+  frontend_audio = audio;
+
+  retro_set_environment( frontend_environment );
+  retro_set_video_refresh( frontend_video_refresh );
+  retro_set_audio_sample( frontend_audio_sample );
+  retro_set_audio_sample_batch( frontend_audio_sample_batch );
+  retro_set_input_poll( frontend_input_poll );
+  retro_set_input_state( frontend_input_state );
+
+  retro_init();
+}
+
+unsigned char*
+frontend_read_file( const char *filename, size_t *length )
+{
+  FILE *f;
+  unsigned char *buffer;
+  long size;
+
+  f = fopen( filename, "rb" );
+  if( !f ) {
+    fprintf( stderr, "couldn't open '%s'\n", filename );
+    return NULL;
+  }
+
+  if( fseek( f, 0, SEEK_END ) || ( size = ftell( f ) ) < 0 ) {
+    fprintf( stderr, "couldn't get the size of '%s'\n", filename );
+    fclose( f );
+    return NULL;
+  }
+  rewind( f );
+
+  buffer = malloc( size ? size : 1 );
+  if( !buffer || fread( buffer, 1, size, f ) != (size_t)size ) {
+    fprintf( stderr, "couldn't read '%s'\n", filename );
+    free( buffer );
+    fclose( f );
+    return NULL;
+  }
+
+  fclose( f );
+
+  *length = size;
+  return buffer;
+}
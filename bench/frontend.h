@@ -0,0 +1,59 @@
+/* frontend.h: Minimal libretro frontend for the benchmarks
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_BENCH_FRONTEND_H
+#define FUSE_BENCH_FRONTEND_H
+
+#include <stddef.h>
+
+#include "libretro.h"
+
+/* Just enough of a frontend to run the core headless and unthrottled:
+   core options, logging of warnings and errors, and a perf interface
+   which keeps its counters in nanoseconds. Video and audio go to the
+   given callbacks, either of which may be NULL to discard them; there
+   is never any input */
+
+/* Set core option `key'; must be called before frontend_init() */
+int frontend_option( const char *key, const char *value );
+
+/* Where the core should look for ROMs it doesn't have built in, such as
+   the Pentagon's; must also be called before frontend_init() */
+void frontend_system_directory( const char *directory );
+
+/* Whether to tell the core the frontend is fast-forwarding */
+void frontend_fast_forward( int fast_forward );
+
+/* Hand the callbacks to the core and call retro_init() */
+void frontend_init( retro_video_refresh_t video,
+                    retro_audio_sample_batch_t audio );
+
+/* Read `filename' into a malloc()ed buffer */
+unsigned char* frontend_read_file( const char *filename, size_t *length );
+
+/* The current time, in nanoseconds */
+retro_perf_tick_t frontend_time( void );
+
+/* The counter registered as `ident', or NULL if it hasn't been (yet) */
+const struct retro_perf_counter* frontend_counter( const char *ident );
+
+/* Zero all the registered counters */
+void frontend_counters_reset( void );
+
+#endif			/* #ifndef FUSE_BENCH_FRONTEND_H */
@@ -0,0 +1,220 @@
+/* fuse_bench.c: Headless benchmark runner for the libretro core
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Drives the core through the libretro API as a frontend would, but with
+   no video, audio or input and no frame pacing, and reports how fast it
+   went. The core is built with LOG_PERFORMANCE, and this program supplies
+   the perf interface the counters in src/libretro.c and fuse/spectrum.c
+   report through, so the time can be broken down by subsystem:
+
+     z80              z80_do_opcodes()
+     events           event_do_events(), less the two below
+     sound_frame      end of frame sound processing
+     display_frame    end of frame display processing
+     render_video     conversion to the frontend's framebuffer
+     rewind_capture   adding each frame to the rewind history
+
+   It also reports how many frames were passed on to the frontend as
+   duplicates, and how much of the screen changed in the rest.
+
+   With the fuse_rewind core option set, it also reports how much memory
+   the rewind history took for each minute of emulated time.
+
+   Usage: fuse_bench [-f] [-m <machine>] [-n <frames>] [-o <key>=<value>]...
+                     [-s <directory>] [<file>]
+
+   where <machine> is a value of the fuse_machine core option, and -o sets
+   any other core option. -f tells the core the frontend is fast-forwarding
+   throughout, for timing the fuse_fast_forward_skip core option. -s gives
+   the frontend's system directory, where the core looks for the ROMs it
+   doesn't have built in, under fuse/.
+   <file> is anything the core can load: TAP, TZX, Z80, SZX, RZX and so on.
+   With no file, the machine just sits in BASIC */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <libspectrum.h>
+
+#include "externs.h"
+#include "frontend.h"
+#include "machine.h"
+#include "rewind.h"
+
+static unsigned long video_frames = 0, dupe_frames = 0;
+
+static void
+bench_video( const void *data, unsigned width, unsigned height, size_t pitch )
+{
+  video_frames++;
+  if( !data ) dupe_frames++;
+}
+
+static double
+counter_seconds( const char *ident )
+{
+  const struct retro_perf_counter *counter = frontend_counter( ident );
+  return counter ? counter->total / 1e9 : 0;
+}
+
+static void
+report_line( const char *name, double seconds, double elapsed,
+             unsigned long frames )
+{
+  printf( "  %-14s %10.3f ms %7.3f ms/frame %6.1f%%\n", name,
+          seconds * 1e3, frames ? seconds * 1e3 / frames : 0,
+          elapsed > 0 ? seconds * 100 / elapsed : 0 );
+}
+
+static void
+usage( void )
+{
+  fprintf( stderr,
+           "Usage: fuse_bench [-f] [-m <machine>] [-n <frames>] "
+           "[-o <key>=<value>]... [-s <directory>] [<file>]\n" );
+}
+
+int
+main( int argc, char **argv )
+{
+  struct retro_game_info info;
+  const struct retro_perf_counter *spectrum_frame;
+  unsigned char *content = NULL;
+  unsigned long i, runs = 3000, frames;
+  double start, elapsed, z80, events, sound, display, render, rewind, other;
+  double frame_rate;
+  struct rusage usage_info;
+  int arg;
+
+  for( arg = 1; arg < argc && argv[ arg ][0] == '-'; arg++ ) {
+    char *value;
+
+    if( !strcmp( argv[ arg ], "-f" ) ) {
+      frontend_fast_forward( 1 );
+    } else if( !strcmp( argv[ arg ], "-m" ) && arg + 1 < argc ) {
+      if( frontend_option( "fuse_machine", argv[ ++arg ] ) ) return 1;
+    } else if( !strcmp( argv[ arg ], "-s" ) && arg + 1 < argc ) {
+      frontend_system_directory( argv[ ++arg ] );
+    } else if( !strcmp( argv[ arg ], "-n" ) && arg + 1 < argc ) {
+      runs = strtoul( argv[ ++arg ], NULL, 10 );
+    } else if( !strcmp( argv[ arg ], "-o" ) && arg + 1 < argc &&
+               ( value = strchr( argv[ arg + 1 ], '=' ) ) ) {
+      *value++ = '\0';
+      if( frontend_option( argv[ ++arg ], value ) ) return 1;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if( arg + 1 < argc ) {
+    usage();
+    return 1;
+  }
+
+  memset( &info, 0, sizeof( info ) );
+
+  if( arg < argc ) {
+    content = frontend_read_file( argv[ arg ], &info.size );
+    if( !content ) return 1;
+
+    info.path = argv[ arg ];
+    info.data = content;
+  }
+
+  frontend_init( bench_video, NULL );
+
+  if( !retro_load_game( &info ) ) {
+    fprintf( stderr, "fuse_bench: couldn't load '%s'\n",
+             info.path ? info.path : "BASIC" );
+    return 1;
+  }
+
+  /* Only count what happens from here on */
+  frontend_counters_reset();
+  video_frames = dupe_frames = 0;
+  memset( &video_stats, 0, sizeof( video_stats ) );
+
+  start = frontend_time() / 1e9;
+  for( i = 0; i < runs; i++ ) retro_run();
+  elapsed = frontend_time() / 1e9 - start;
+
+  getrusage( RUSAGE_SELF, &usage_info );
+
+  spectrum_frame = frontend_counter( "spectrum_frame" );
+  frames = spectrum_frame ? spectrum_frame->call_cnt : runs;
+
+  z80 = counter_seconds( "z80_do_opcodes" );
+  sound = counter_seconds( "sound_frame" );
+  display = counter_seconds( "display_frame" );
+  events = counter_seconds( "event_do_events" ) - sound - display;
+  render = counter_seconds( "render_video" );
+  rewind = counter_seconds( "rewind_capture" );
+  other = elapsed - z80 - events - sound - display - render - rewind;
+
+  frame_rate = machine_current->timings.processor_speed /
+               (double)machine_current->timings.tstates_per_frame;
+
+  printf( "%s: %s\n", machine_current->id, info.path ? info.path : "BASIC" );
+  printf( "  %lu retro_run calls, %lu emulated frames, %lu video frames "
+          "in %.3f s\n", runs, frames, video_frames, elapsed );
+  printf( "  %.1f frames/sec (%.1fx real time)\n", frames / elapsed,
+          frames / elapsed / frame_rate );
+
+  /* Exact except with RZX playback, where frames may be of any length */
+  printf( "  %.0f T-states/sec\n",
+          (double)frames * machine_current->timings.tstates_per_frame /
+          elapsed );
+
+  /* How much of the screen Fuse redrew in each frame it showed */
+  printf( "  %lu duplicate video frames, %.1f%% of the screen redrawn "
+          "per frame shown\n", dupe_frames,
+          video_stats.frames && video_stats.screen_pixels ?
+            100.0 * video_stats.total_pixels / video_stats.frames /
+            video_stats.screen_pixels : 0 );
+
+  report_line( "z80", z80, elapsed, frames );
+  report_line( "events", events, elapsed, frames );
+  report_line( "sound_frame", sound, elapsed, frames );
+  report_line( "display_frame", display, elapsed, frames );
+  report_line( "render_video", render, elapsed, frames );
+  if( rewind_count() ) report_line( "rewind_capture", rewind, elapsed, frames );
+  report_line( "other", other, elapsed, frames );
+
+  /* One capture per frame, so the history covers rewind_count() frames */
+  if( rewind_count() )
+    printf( "  rewind history %lu states, %.1f KB, %.1f KB per minute\n",
+            (unsigned long)rewind_count(), rewind_memory_used() / 1024.0,
+            rewind_memory_used() / 1024.0 /
+              ( rewind_count() / frame_rate / 60 ) );
+
+  /* ru_maxrss is in kilobytes on Linux */
+  printf( "  peak RSS %ld KB\n", usage_info.ru_maxrss );
+
+  retro_unload_game();
+  retro_deinit();
+
+  free( content );
+
+  return 0;
+}
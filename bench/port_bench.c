@@ -0,0 +1,265 @@
+/* port_bench.c: Microbenchmark for peripheral port decoding
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Times readport_internal() and writeport_internal() in fuse/periph.c for
+   the port traffic of a tape loader, a keyboard scan and an AY music
+   player. The peripherals have the same port decoding as a 128K with a
+   Kempston joystick, and then as one with a selection of interfaces
+   attached as well. Only periph.c and the glib replacements are linked
+   in, so the same program can be built against older versions of the
+   port code for comparison */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libspectrum.h>
+
+#include "compat.h"
+#include "debugger/debugger.h"
+#include "event.h"
+#include "machine.h"
+#include "periph.h"
+#include "rzx.h"
+#include "settings.h"
+#include "ui/ui.h"
+
+/* Pieces of the emulator periph.c needs */
+libspectrum_dword tstates;
+fuse_machine_info *machine_current;
+settings_info settings_current;
+enum debugger_mode_t debugger_mode = DEBUGGER_MODE_INACTIVE;
+int event_type_null;
+int rzx_playback, rzx_recording;
+libspectrum_rzx *rzx;
+int ui_mouse_present, ui_mouse_grabbed;
+const int LIBSPECTRUM_MACHINE_CAPABILITY_TIMEX_DOCK = 1 << 6;
+
+int debugger_check( debugger_breakpoint_type type GCC_UNUSED,
+                    libspectrum_dword value GCC_UNUSED ) { return 0; }
+int debugger_event_register( const char *type GCC_UNUSED,
+                             const char *detail GCC_UNUSED ) { return 0; }
+void event_add_with_data( libspectrum_dword event_time GCC_UNUSED,
+                          int type GCC_UNUSED,
+                          void *user_data GCC_UNUSED ) {}
+libspectrum_error
+libspectrum_rzx_playback( libspectrum_rzx *r GCC_UNUSED,
+                          libspectrum_byte *byte GCC_UNUSED ) { return 0; }
+int rzx_stop_playback( int add_interrupt GCC_UNUSED ) { return 0; }
+int rzx_store_byte( libspectrum_byte value GCC_UNUSED ) { return 0; }
+int ui_menu_activate( ui_menu_item item GCC_UNUSED,
+                      int active GCC_UNUSED ) { return 0; }
+int ui_mouse_grab( int startup GCC_UNUSED ) { return 0; }
+int ui_mouse_release( int suspend GCC_UNUSED ) { return 0; }
+int machine_reset( int hard_reset GCC_UNUSED ) { return 0; }
+void if1_update_menu( void ) {}
+void specplus3_765_update_fdd( void ) {}
+void ula_contend_port_early( libspectrum_word port GCC_UNUSED ) {}
+void ula_contend_port_late( libspectrum_word port GCC_UNUSED ) {}
+
+/* Somewhere for the port writes to go, so they can't be optimised away */
+static volatile libspectrum_byte sink;
+
+static libspectrum_byte
+bench_read( libspectrum_word port, int *attached )
+{
+  *attached = 1;
+  return port >> 8;
+}
+
+static void
+bench_write( libspectrum_word port GCC_UNUSED, libspectrum_byte b )
+{
+  sink = b;
+}
+
+static libspectrum_byte
+bench_unattached( void )
+{
+  return 0xff;
+}
+
+/* The port decoding of the peripherals on a 128K */
+
+static const periph_port_t ula_ports[] = {
+  { 0x0001, 0x0000, bench_read, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t ay_ports[] = {
+  { 0xc002, 0xc000, bench_read, bench_write },
+  { 0xc002, 0x8000, NULL, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t memory_ports[] = {
+  { 0x8002, 0x0000, NULL, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t kempston_ports[] = {
+  { 0x00e0, 0x0000, bench_read, NULL },
+  { 0, 0, NULL, NULL }
+};
+
+/* And some interfaces which might be plugged into it */
+
+static const periph_port_t beta_ports[] = {
+  { 0x00ff, 0x001f, bench_read, bench_write },
+  { 0x00ff, 0x003f, bench_read, bench_write },
+  { 0x00ff, 0x005f, bench_read, bench_write },
+  { 0x00ff, 0x007f, bench_read, bench_write },
+  { 0x00ff, 0x00ff, bench_read, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t if1_ports[] = {
+  { 0x0018, 0x0010, bench_read, bench_write },
+  { 0x0018, 0x0008, bench_read, bench_write },
+  { 0x0018, 0x0000, bench_read, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t divide_ports[] = {
+  { 0x00e3, 0x00a3, bench_read, bench_write },
+  { 0x00ff, 0x00e3, NULL, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t printer_ports[] = {
+  { 0x0004, 0x0000, bench_read, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t fuller_ports[] = {
+  { 0x00ff, 0x003f, bench_read, bench_write },
+  { 0x00ff, 0x005f, NULL, bench_write },
+  { 0x00ff, 0x007f, bench_read, NULL },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_port_t melodik_ports[] = {
+  { 0xc002, 0xc000, bench_read, bench_write },
+  { 0xc002, 0x8000, NULL, bench_write },
+  { 0, 0, NULL, NULL }
+};
+
+static const periph_t ula_periph = { NULL, ula_ports, 0, NULL };
+static const periph_t ay_periph = { NULL, ay_ports, 0, NULL };
+static const periph_t memory_periph = { NULL, memory_ports, 0, NULL };
+static const periph_t kempston_periph = { NULL, kempston_ports, 0, NULL };
+static const periph_t beta_periph = { NULL, beta_ports, 0, NULL };
+static const periph_t if1_periph = { NULL, if1_ports, 0, NULL };
+static const periph_t divide_periph = { NULL, divide_ports, 0, NULL };
+static const periph_t printer_periph = { NULL, printer_ports, 0, NULL };
+static const periph_t fuller_periph = { NULL, fuller_ports, 0, NULL };
+static const periph_t melodik_periph = { NULL, melodik_ports, 0, NULL };
+
+static double
+now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define ACCESSES 4000000
+
+static void
+report( const char *name, double start )
+{
+  double elapsed = now() - start;
+  printf( "  %-14s %8.1f ns/access %10.0f accesses/sec\n", name,
+          elapsed * 1e9 / ACCESSES, ACCESSES / elapsed );
+}
+
+static void
+run( const char *configuration )
+{
+  static const libspectrum_byte rows[] =
+    { 0xfe, 0xfd, 0xfb, 0xf7, 0xef, 0xdf, 0xbf, 0x7f };
+  libspectrum_byte total = 0;
+  double start;
+  int i;
+
+  printf( "%s:\n", configuration );
+
+  /* LD-EDGE-1: IN A,(0xfe) with A = 0x7f, over and over */
+  start = now();
+  for( i = 0; i < ACCESSES; i++ ) total += readport_internal( 0x7ffe );
+  report( "tape loader", start );
+
+  /* The ROM keyboard scan: every half-row in turn */
+  start = now();
+  for( i = 0; i < ACCESSES; i++ )
+    total += readport_internal( ( rows[ i & 7 ] << 8 ) | 0xfe );
+  report( "keyboard scan", start );
+
+  /* Select an AY register and write to it */
+  start = now();
+  for( i = 0; i < ACCESSES; i += 2 ) {
+    writeport_internal( 0xfffd, ( i >> 1 ) % 14 );
+    writeport_internal( 0xbffd, i );
+  }
+  report( "AY player", start );
+
+  sink = total;
+}
+
+int
+main( void )
+{
+  static fuse_machine_info machine;
+
+  machine.unattached_port = bench_unattached;
+  machine_current = &machine;
+
+  periph_register( PERIPH_TYPE_ULA, &ula_periph );
+  periph_register( PERIPH_TYPE_AY, &ay_periph );
+  periph_register( PERIPH_TYPE_128_MEMORY, &memory_periph );
+  periph_register( PERIPH_TYPE_KEMPSTON, &kempston_periph );
+  periph_register( PERIPH_TYPE_BETA128, &beta_periph );
+  periph_register( PERIPH_TYPE_INTERFACE1, &if1_periph );
+  periph_register( PERIPH_TYPE_DIVIDE, &divide_periph );
+  periph_register( PERIPH_TYPE_ZXPRINTER, &printer_periph );
+  periph_register( PERIPH_TYPE_FULLER, &fuller_periph );
+  periph_register( PERIPH_TYPE_MELODIK, &melodik_periph );
+
+  periph_activate_type( PERIPH_TYPE_ULA, 1 );
+  periph_activate_type( PERIPH_TYPE_AY, 1 );
+  periph_activate_type( PERIPH_TYPE_128_MEMORY, 1 );
+  periph_activate_type( PERIPH_TYPE_KEMPSTON, 1 );
+
+  run( "128K with Kempston joystick" );
+
+  periph_activate_type( PERIPH_TYPE_BETA128, 1 );
+  periph_activate_type( PERIPH_TYPE_INTERFACE1, 1 );
+  periph_activate_type( PERIPH_TYPE_DIVIDE, 1 );
+  periph_activate_type( PERIPH_TYPE_ZXPRINTER, 1 );
+  periph_activate_type( PERIPH_TYPE_FULLER, 1 );
+  periph_activate_type( PERIPH_TYPE_MELODIK, 1 );
+
+  run( "128K with interfaces" );
+
+  periph_end();
+
+  return 0;
+}
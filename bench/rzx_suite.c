@@ -0,0 +1,404 @@
+/* rzx_suite.c: Deterministic regression and speed test from RZX files
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* Plays back each RZX recording given as fast as it will go, and every
+   so many frames hashes the picture in image_buffer and all the sound
+   produced so far. An RZX recording fixes the machine's input, so these
+   hashes should only change when the emulation does; comparing them
+   against a set of golden hashes checks that changes to the Z80 core,
+   the contention tables or the display code which are only meant to make
+   things faster haven't changed anything else.
+
+   Usage: rzx_suite [-c <frames>] [-g <golden>] [-u] [-j <jobs>]
+                    [-o <key>=<value>]... <file>...
+
+     -c  hash every <frames> frames (default 50), and at the end
+     -g  the golden hashes to compare against
+     -u  write the hashes to the golden file rather than comparing them
+     -j  play up to <jobs> recordings at once (default 1)
+     -o  set a core option
+
+   With no golden file, the recordings are just played for their speed.
+
+   The golden file has one line for each checkpoint:
+
+     <recording> <frame> <video hash> <audio hash>
+
+   Each recording is played in a process of its own, as the core only
+   expects to load one piece of content in its lifetime, which also lets
+   a large corpus be checked on several CPUs at once with -j; the speeds
+   reported are then only comparable with other runs with the same number
+   of jobs. -j is ignored with -u so the golden file stays in the order
+   the recordings were given. The exit status
+   is non-zero if any recording didn't match its golden hashes or
+   couldn't be played */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <libspectrum.h>
+
+#include "externs.h"
+#include "frontend.h"
+#include "rzx.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct checkpoint_t {
+  char *name;
+  unsigned long frame;
+  libspectrum_qword video, audio;
+} checkpoint_t;
+
+static checkpoint_t *golden = NULL;
+static size_t golden_count = 0, golden_allocated = 0;
+
+static int compare = 0;
+
+static libspectrum_qword audio_hash;
+
+static libspectrum_qword
+hash( libspectrum_qword h, const void *data, size_t length )
+{
+  const libspectrum_byte *ptr = data;
+
+  while( length-- ) {
+    h ^= *ptr++;
+    h *= FNV_PRIME;
+  }
+
+  return h;
+}
+
+static libspectrum_qword
+video_hash( void )
+{
+  libspectrum_qword h = FNV_OFFSET;
+  unsigned y;
+
+  for( y = 0; y < hard_height; y++ )
+    h = hash( h, image_buffer + y * hard_width,
+              hard_width * sizeof( image_buffer[0] ) );
+
+  return h;
+}
+
+static size_t
+suite_audio( const int16_t *data, size_t frames )
+{
+  audio_hash = hash( audio_hash, data, frames * 2 * sizeof( data[0] ) );
+  return frames;
+}
+
+static const char*
+basename_of( const char *filename )
+{
+  const char *slash = strrchr( filename, '/' );
+  return slash ? slash + 1 : filename;
+}
+
+static int
+golden_read( const char *filename )
+{
+  FILE *f;
+  char line[ 512 ], name[ 256 ];
+  unsigned long frame;
+  unsigned long long video, audio;
+
+  f = fopen( filename, "r" );
+  if( !f ) {
+    fprintf( stderr, "rzx_suite: couldn't open '%s'\n", filename );
+    return 1;
+  }
+
+  while( fgets( line, sizeof( line ), f ) ) {
+    if( line[0] == '#' || line[0] == '\n' ) continue;
+
+    if( sscanf( line, "%255s %lu %llx %llx", name, &frame, &video,
+                &audio ) != 4 ) {
+      fprintf( stderr, "rzx_suite: bad line in '%s': %s", filename, line );
+      fclose( f );
+      return 1;
+    }
+
+    if( golden_count == golden_allocated ) {
+      golden_allocated = golden_allocated ? 2 * golden_allocated : 64;
+      golden = realloc( golden, golden_allocated * sizeof( *golden ) );
+      if( !golden ) {
+        fprintf( stderr, "rzx_suite: out of memory\n" );
+        fclose( f );
+        return 1;
+      }
+    }
+
+    golden[ golden_count ].name = strdup( name );
+    golden[ golden_count ].frame = frame;
+    golden[ golden_count ].video = video;
+    golden[ golden_count ].audio = audio;
+    golden_count++;
+  }
+
+  fclose( f );
+
+  return 0;
+}
+
+/* Find the golden hashes for the `index'th checkpoint of `name' */
+static const checkpoint_t*
+golden_find( const char *name, size_t index )
+{
+  size_t i;
+
+  for( i = 0; i < golden_count; i++ )
+    if( !strcmp( golden[i].name, name ) && !index-- ) return &golden[i];
+
+  return NULL;
+}
+
+/* Load the content with Fuse's start up banner out of the way */
+static int
+load_quietly( const struct retro_game_info *info )
+{
+  int saved, null, loaded;
+
+  fflush( stdout );
+  saved = dup( STDOUT_FILENO );
+  null = open( "/dev/null", O_WRONLY );
+  if( saved >= 0 && null >= 0 ) dup2( null, STDOUT_FILENO );
+
+  loaded = retro_load_game( info );
+
+  fflush( stdout );
+  if( saved >= 0 ) {
+    dup2( saved, STDOUT_FILENO );
+    close( saved );
+  }
+  if( null >= 0 ) close( null );
+
+  return loaded;
+}
+
+/* Returns 0 if everything matched, 1 if not and 2 if the recording
+   couldn't be played */
+static int
+play( const char *filename, unsigned long interval, FILE *update )
+{
+  struct retro_game_info info;
+  unsigned char *content;
+  const char *name = basename_of( filename );
+  const checkpoint_t *expected;
+  unsigned long frame = 0;
+  retro_perf_tick_t start, elapsed = 0;
+  size_t checkpoints = 0;
+  int mismatch = 0, end = 0;
+
+  memset( &info, 0, sizeof( info ) );
+  content = frontend_read_file( filename, &info.size );
+  if( !content ) return 2;
+
+  info.path = filename;
+  info.data = content;
+
+  frontend_init( NULL, suite_audio );
+
+  if( !load_quietly( &info ) || !rzx_playback ) {
+    fprintf( stderr, "rzx_suite: couldn't start playback of '%s'\n",
+             filename );
+    return 2;
+  }
+
+  audio_hash = FNV_OFFSET;
+
+  while( !end ) {
+
+    start = frontend_time();
+    retro_run();
+    elapsed += frontend_time() - start;
+    frame++;
+
+    end = !rzx_playback;
+    if( frame % interval && !end ) continue;
+
+    if( update ) {
+      fprintf( update, "%s %lu %016llx %016llx\n", name, frame,
+               (unsigned long long)video_hash(),
+               (unsigned long long)audio_hash );
+    } else if( compare && !mismatch ) {
+      expected = golden_find( name, checkpoints );
+
+      if( !expected ) {
+        printf( "%s: no golden hashes for frame %lu\n", name, frame );
+        mismatch = 1;
+      } else if( expected->frame != frame ) {
+        printf( "%s: expected checkpoint at frame %lu, got frame %lu\n",
+                name, expected->frame, frame );
+        mismatch = 1;
+      } else if( expected->video != video_hash() ) {
+        printf( "%s: video mismatch at frame %lu\n", name, frame );
+        mismatch = 1;
+      } else if( expected->audio != audio_hash ) {
+        printf( "%s: audio mismatch at frame %lu\n", name, frame );
+        mismatch = 1;
+      }
+    }
+
+    checkpoints++;
+  }
+
+  if( compare && !mismatch && golden_find( name, checkpoints ) ) {
+    printf( "%s: playback ended early at frame %lu\n", name, frame );
+    mismatch = 1;
+  }
+
+  printf( "%-24s %-6s %8lu frames %9.1f frames/sec\n", name,
+          update ? "saved" : !compare ? "played" : mismatch ? "FAIL" : "ok",
+          frame,
+          elapsed ? frame / ( elapsed / 1e9 ) : 0 );
+
+  retro_unload_game();
+  retro_deinit();
+
+  free( content );
+
+  return mismatch;
+}
+
+static void
+usage( void )
+{
+  fprintf( stderr,
+           "Usage: rzx_suite [-c <frames>] [-g <golden>] [-u] [-j <jobs>] "
+           "[-o <key>=<value>]... <file>...\n" );
+}
+
+int
+main( int argc, char **argv )
+{
+  const char *golden_file = NULL;
+  unsigned long interval = 50, jobs = 1;
+  FILE *update = NULL;
+  int arg, update_golden = 0, failed = 0, status;
+  size_t running = 0;
+  pid_t pid, *pids;
+
+  for( arg = 1; arg < argc && argv[ arg ][0] == '-'; arg++ ) {
+    char *value;
+
+    if( !strcmp( argv[ arg ], "-c" ) && arg + 1 < argc ) {
+      interval = strtoul( argv[ ++arg ], NULL, 10 );
+    } else if( !strcmp( argv[ arg ], "-g" ) && arg + 1 < argc ) {
+      golden_file = argv[ ++arg ];
+    } else if( !strcmp( argv[ arg ], "-u" ) ) {
+      update_golden = 1;
+    } else if( !strcmp( argv[ arg ], "-j" ) && arg + 1 < argc ) {
+      jobs = strtoul( argv[ ++arg ], NULL, 10 );
+    } else if( !strcmp( argv[ arg ], "-o" ) && arg + 1 < argc &&
+               ( value = strchr( argv[ arg + 1 ], '=' ) ) ) {
+      *value++ = '\0';
+      if( frontend_option( argv[ ++arg ], value ) ) return 2;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  if( arg == argc || !interval || !jobs ||
+      ( update_golden && !golden_file ) ) {
+    usage();
+    return 2;
+  }
+
+  if( update_golden ) {
+    update = fopen( golden_file, "w" );
+    if( !update ) {
+      fprintf( stderr, "rzx_suite: couldn't open '%s' for writing\n",
+               golden_file );
+      return 2;
+    }
+    fprintf( update, "# <recording> <frame> <video hash> <audio hash>\n" );
+    fflush( update );
+    jobs = 1;
+  } else if( golden_file ) {
+    if( golden_read( golden_file ) ) return 2;
+    compare = 1;
+  }
+
+  /* The process playing each recording, indexed like argv */
+  pids = calloc( (unsigned)argc, sizeof( *pids ) );
+  if( !pids ) {
+    fprintf( stderr, "rzx_suite: out of memory\n" );
+    return 2;
+  }
+
+  while( arg < argc || running ) {
+
+    if( arg < argc && running < jobs ) {
+
+      fflush( stdout );
+
+      pid = fork();
+      if( pid < 0 ) {
+        perror( "rzx_suite: fork" );
+        return 2;
+      }
+
+      if( !pid ) {
+        status = play( argv[ arg ], interval, update );
+        if( update ) fflush( update );
+        fflush( stdout );
+        _exit( status );
+      }
+
+      pids[ arg++ ] = pid;
+      running++;
+      continue;
+    }
+
+    pid = waitpid( -1, &status, 0 );
+    if( pid < 0 ) {
+      perror( "rzx_suite: waitpid" );
+      return 2;
+    }
+    running--;
+
+    if( !WIFEXITED( status ) ) {
+      int i;
+      for( i = 0; pids[i] != pid; i++ )
+        ;
+      printf( "%-24s crashed\n", basename_of( argv[ i ] ) );
+      failed = 1;
+    } else if( WEXITSTATUS( status ) ) {
+      failed = 1;
+    }
+  }
+
+  free( pids );
+
+  if( update ) fclose( update );
+
+  return failed;
+}
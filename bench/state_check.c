@@ -0,0 +1,191 @@
+/* state_check.c: Check that loading a state brings the AY's sound with it
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+/* The AY's registers are part of a state, but what the sound code is
+   making from them isn't, so loading a state has to tell it about them.
+   This sets a 48K with a Fuller Box playing a tone through the Fuller's
+   ports, saves a state, and then loads it twice: once over the same
+   tone, and once over silence. The tone's period and the envelope are
+   the same both times, so the only thing loading the state has to put
+   back is the mixer and volumes; if it does, the sound after each load
+   is as loud as the other, frame for frame.
+
+   Usage: state_check [-o <key>=<value>]...
+
+   The exit status is non-zero if the sound after the two loads didn't
+   match */
+
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libspectrum.h>
+
+#include "frontend.h"
+#include "periph.h"
+
+/* The Fuller Box's register select and data ports */
+#define FULLER_REGISTER_PORT 0x3f
+#define FULLER_DATA_PORT 0x5f
+
+/* Frames after a load which are compared; the first few are left out, as
+   the sound thread passes each frame on a frame late and the step from
+   silence to the tone takes a frame or so to settle */
+#define CHECK_FRAMES 20
+#define SETTLE_FRAMES 3
+
+/* How far the loudness of a frame after the two loads may differ, and how
+   loud the tone must be for the check to mean anything */
+#define TOLERANCE 0.05
+#define MIN_RMS 500
+
+static double sum_squares;
+static size_t samples;
+
+static size_t
+check_audio( const int16_t *data, size_t frames )
+{
+  size_t i;
+
+  for( i = 0; i < frames; i++ )
+    sum_squares += (double)data[ 2 * i ] * data[ 2 * i ];
+  samples += frames;
+
+  return frames;
+}
+
+static double
+run_frame( void )
+{
+  sum_squares = 0; samples = 0;
+  retro_run();
+  return samples ? sqrt( sum_squares / samples ) : 0;
+}
+
+static void
+fuller_write( libspectrum_byte reg, libspectrum_byte value )
+{
+  writeport_internal( FULLER_REGISTER_PORT, reg );
+  writeport_internal( FULLER_DATA_PORT, value );
+}
+
+/* Channel A on its own at full volume, or with the same period but
+   nothing mixed in */
+static void
+set_tone( int audible )
+{
+  fuller_write( 0, 200 );
+  fuller_write( 1, 0 );
+  fuller_write( 7, audible ? 0x3e : 0x3f );
+  fuller_write( 8, audible ? 15 : 0 );
+}
+
+static int
+load_and_listen( const void *state, size_t size, double *rms )
+{
+  size_t i;
+
+  if( !retro_unserialize( state, size ) ) return 1;
+
+  for( i = 0; i < CHECK_FRAMES; i++ ) rms[i] = run_frame();
+
+  return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+  struct retro_game_info info;
+  double same[ CHECK_FRAMES ], silenced[ CHECK_FRAMES ];
+  void *state;
+  size_t size, i;
+  int arg, error = 0;
+
+  if( frontend_option( "fuse_machine", "Spectrum 48K" ) ) return 1;
+
+  for( arg = 1; arg < argc; arg++ ) {
+    char *value;
+
+    if( !strcmp( argv[ arg ], "-o" ) && arg + 1 < argc &&
+        ( value = strchr( argv[ arg + 1 ], '=' ) ) ) {
+      *value++ = '\0';
+      if( frontend_option( argv[ ++arg ], value ) ) return 1;
+    } else {
+      fprintf( stderr, "Usage: state_check [-o <key>=<value>]...\n" );
+      return 1;
+    }
+  }
+
+  memset( &info, 0, sizeof( info ) );
+
+  frontend_init( NULL, check_audio );
+
+  if( !retro_load_game( &info ) ) {
+    fprintf( stderr, "state_check: couldn't start the machine\n" );
+    return 1;
+  }
+
+  for( i = 0; i < 100; i++ ) run_frame();
+
+  set_tone( 1 );
+  for( i = 0; i < 10; i++ ) run_frame();
+
+  size = retro_serialize_size();
+  state = malloc( size );
+  if( !state || !retro_serialize( state, size ) ) {
+    fprintf( stderr, "state_check: couldn't save a state\n" );
+    return 1;
+  }
+
+  for( i = 0; i < 10; i++ ) run_frame();
+  if( load_and_listen( state, size, same ) ) error = 1;
+
+  set_tone( 0 );
+  for( i = 0; i < 10; i++ ) run_frame();
+  if( load_and_listen( state, size, silenced ) ) error = 1;
+
+  if( error ) {
+    fprintf( stderr, "state_check: couldn't load the state\n" );
+    return 1;
+  }
+
+  for( i = SETTLE_FRAMES; i < CHECK_FRAMES; i++ ) {
+    if( same[i] < MIN_RMS ) {
+      printf( "frame %lu: the tone isn't playing (RMS %.0f)\n",
+              (unsigned long)i, same[i] );
+      error = 1;
+    } else if( fabs( silenced[i] - same[i] ) > TOLERANCE * same[i] ) {
+      printf( "frame %lu: RMS %.0f after loading over silence, %.0f over "
+              "the tone\n", (unsigned long)i, silenced[i], same[i] );
+      error = 1;
+    }
+  }
+
+  if( !error ) printf( "AY state load ok\n" );
+
+  retro_unload_game();
+  retro_deinit();
+
+  free( state );
+
+  return error;
+}
@@ -35,18 +35,25 @@
 #include "event.h"
 #include "fuse.h"
 #include "machine.h"
+#include "module.h"
 #include "movie.h"
 #include "peripherals/scld.h"
 #include "rectangle.h"
 #include "screenshot.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "ui/uidisplay.h"
 
 /* Set once we have initialised the UI */
 int display_ui_initialised = 0;
 
+/* Set while frames aren't being shown: nothing is drawn, but every chunk
+   which may have changed stays marked, to be drawn in the next frame which
+   is shown */
+int display_suspended = 0;
+
 /* The current border colour */
 libspectrum_byte display_lores_border;
 libspectrum_byte display_hires_border;
@@ -130,6 +137,23 @@ static void display_get_attr( int x, int y,
 static int border_changes_last = 0;
 static struct border_change_t *border_changes = NULL;
 
+static size_t display_state_size( void );
+static void display_state_save( libspectrum_byte **ptr );
+static void display_state_load( const libspectrum_byte **ptr );
+
+static module_info_t display_module_info = {
+
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  display_state_size,
+  display_state_save,
+  display_state_load,
+
+};
+
 static struct border_change_t *
 alloc_change(void)
 {
@@ -197,6 +221,8 @@ display_init( int *argc, char ***argv )
 
   display_refresh_all();
 
+  module_register( &display_module_info );
+
   border_changes_last = 0;
   if( border_changes ) {
     libspectrum_free( border_changes );
@@ -278,6 +304,19 @@ display_dirty_sinclair( libspectrum_word offset )
   }
 }
 
+static inline void
+parse_attr( libspectrum_byte attr,
+            libspectrum_byte *ink, libspectrum_byte *paper )
+{
+  if( (attr & 0x80) && display_flash_reversed ) {
+    *ink  = (attr & ( 0x0f << 3 ) ) >> 3;
+    *paper= (attr & 0x07) + ( (attr & 0x40) >> 3 );
+  } else {
+    *ink= (attr & 0x07) + ( (attr & 0x40) >> 3 );
+    *paper= (attr & ( 0x0f << 3 ) ) >> 3;
+  }
+}
+
 /* Get the attribute byte or equivalent for the eight pixels starting at
    ( (8*x) , y ) */
 static inline libspectrum_byte
@@ -339,8 +378,8 @@ update_dirty_rects( void )
   rectangle_end_line( DISPLAY_SCREEN_HEIGHT );
 }
 
-void
-display_write_if_dirty_timex( int x, int y )
+static void
+write_chunk_timex( int x, int y )
 {
   int beam_x, beam_y;
   int index;
@@ -407,6 +446,12 @@ display_write_if_dirty_timex( int x, int y )
   }
 }
 
+void
+display_write_if_dirty_timex( int x, int end, int y )
+{
+  for( ; x < end; x++ ) write_chunk_timex( x, y );
+}
+
 inline static void
 pentagon_16c_get_colour( libspectrum_byte data, libspectrum_byte *colour1,
                          libspectrum_byte *colour2 )
@@ -418,8 +463,8 @@ pentagon_16c_get_colour( libspectrum_byte data, libspectrum_byte *colour1,
 /* In this mode we need to gather the pixel information for the 8 pixels to
    be displayed, if current screen is 5 we need to read from pages 5 and 4,
    and if current screen is 7 we need to read from pages 7 and 6. */
-void
-display_write_if_dirty_pentagon_16_col( int x, int y )
+static void
+write_chunk_pentagon_16_col( int x, int y )
 {
   int beam_x, beam_y;
   int index;
@@ -489,38 +534,80 @@ display_write_if_dirty_pentagon_16_col( int x, int y )
 }
 
 void
-display_write_if_dirty_sinclair( int x, int y )
+display_write_if_dirty_pentagon_16_col( int x, int end, int y )
 {
-  int beam_x, beam_y;
-  int index;
-  libspectrum_word offset;
-  libspectrum_byte *screen;
-  libspectrum_byte data, data2;
-  libspectrum_dword last_chunk_detail;
+  for( ; x < end; x++ ) write_chunk_pentagon_16_col( x, y );
+}
+
+/* The whole run is done in one go: the pixel and attribute addresses
+   for the line are worked out once, and the chunks which have changed
+   are gathered up and handed to the UI together rather than one at a
+   time */
+void
+display_write_if_dirty_sinclair( int x, int end, int y )
+{
+  int beam_y, start = 0, count = 0;
+  const libspectrum_byte *screen, *pixels, *attrs;
+  libspectrum_byte hires_attr = 0;
+  libspectrum_dword *last_screen;
+  libspectrum_qword dirty = 0;
+  libspectrum_byte data[ DISPLAY_WIDTH_COLS ], ink[ DISPLAY_WIDTH_COLS ],
+    paper[ DISPLAY_WIDTH_COLS ];
 
-  beam_x = x + DISPLAY_BORDER_WIDTH_COLS;
   beam_y = y + DISPLAY_BORDER_HEIGHT;
-  offset = display_get_addr( x, y );
 
-  /* Read byte, atrr/byte, and screen mode */
   screen = RAM[ memory_current_screen ];
-  data = screen[ offset ];
-  data2 = display_get_attr_byte( x, y );
+  pixels = screen + display_line_start[y];
+  if( scld_last_dec.name.altdfile ) pixels += ALTDFILE_OFFSET;
 
-  last_chunk_detail = (display_flash_reversed << 24) | (data2 << 8) | data;
-  /* And draw it if it is different to what was there last time */
-  index = beam_x + beam_y * DISPLAY_SCREEN_WIDTH_COLS;
-  if( display_last_screen[ index ] != last_chunk_detail ) {
-    libspectrum_byte ink, paper;
-    display_parse_attr( data2, &ink, &paper );
-    uidisplay_plot8( beam_x, beam_y, data, ink, paper );
+  /* As display_get_attr_byte(), but for the whole line */
+  if( scld_last_dec.name.hires ) {
+    attrs = NULL;
+    hires_attr = hires_get_attr();
+  } else if( scld_last_dec.name.b1 ) {
+    attrs = screen + display_line_start[y] + ALTDFILE_OFFSET;
+  } else if( scld_last_dec.name.altdfile ) {
+    attrs = screen + display_attr_start[y] + ALTDFILE_OFFSET;
+  } else {
+    attrs = screen + display_attr_start[y];
+  }
+
+  last_screen = display_last_screen + beam_y * DISPLAY_SCREEN_WIDTH_COLS +
+                DISPLAY_BORDER_WIDTH_COLS;
+
+  for( ; x < end; x++ ) {
+    libspectrum_byte attr = attrs ? attrs[x] : hires_attr;
+    libspectrum_dword last_chunk_detail =
+      (display_flash_reversed << 24) | (attr << 8) | pixels[x];
+
+    /* Anything which hasn't changed ends the current run of chunks to
+       draw */
+    if( last_screen[x] == last_chunk_detail ) {
+      if( count ) {
+        uidisplay_plot8_run( start + DISPLAY_BORDER_WIDTH_COLS, beam_y, count,
+                             data, ink, paper );
+        count = 0;
+      }
+      continue;
+    }
+
+    if( !count ) start = x;
+    data[ count ] = pixels[x];
+    parse_attr( attr, &ink[ count ], &paper[ count ] );
+    count++;
 
     /* Update last display record */
-    display_last_screen[ index ] = last_chunk_detail;
+    last_screen[x] = last_chunk_detail;
 
-    /* And now mark it dirty */
-    display_is_dirty[ beam_y ] |= ( (libspectrum_qword)1 << beam_x );
+    dirty |= (libspectrum_qword)1 << ( x + DISPLAY_BORDER_WIDTH_COLS );
   }
+
+  if( count )
+    uidisplay_plot8_run( start + DISPLAY_BORDER_WIDTH_COLS, beam_y, count,
+                         data, ink, paper );
+
+  /* And now mark it dirty */
+  display_is_dirty[ beam_y ] |= dirty;
 }
 
 /* Plot any dirty data from ( x, y ) to ( end, y ) of the critical
@@ -529,6 +616,7 @@ static void
 copy_critical_region_line( int y, int x, int end )
 {
   libspectrum_dword bit_mask, dirty;
+  int start;
 
   if( x < DISPLAY_WIDTH_COLS ) {
 
@@ -561,17 +649,18 @@ copy_critical_region_line( int y, int x, int end )
 
     }
 
-    /* Walk to the end of the dirty region, writing the bytes to the
-       drawing area along the way */
+    /* Walk to the end of the dirty region, and write it all to the
+       drawing area in one go */
+    start = x;
     do {
 
-      display_write_if_dirty( x, y );
-
       dirty >>= 1;
       x++;
 
     } while( dirty & 0x01 );
 
+    display_write_if_dirty( start, x, y );
+
   }
   
 }
@@ -620,6 +709,8 @@ display_update_critical( int x, int y )
 {
   int beam_x, beam_y;
 
+  if( display_suspended ) return;
+
   get_beam_position( &beam_x, &beam_y );
 
   beam_x -= DISPLAY_BORDER_WIDTH_COLS;
@@ -694,13 +785,7 @@ void
 display_parse_attr( libspectrum_byte attr,
 		    libspectrum_byte *ink, libspectrum_byte *paper )
 {
-  if( (attr & 0x80) && display_flash_reversed ) {
-    *ink  = (attr & ( 0x0f << 3 ) ) >> 3;
-    *paper= (attr & 0x07) + ( (attr & 0x40) >> 3 );
-  } else {
-    *ink= (attr & 0x07) + ( (attr & 0x40) >> 3 );
-    *paper= (attr & ( 0x0f << 3 ) ) >> 3;
-  }
+  parse_attr( attr, ink, paper );
 }
 
 static void
@@ -709,6 +794,8 @@ push_border_change( int colour )
   int beam_x, beam_y;
   struct border_change_t *change;
 
+  if( display_suspended ) return;
+
   get_beam_position( &beam_x, &beam_y );
 
   if( beam_y >= DISPLAY_SCREEN_HEIGHT ) return;
@@ -760,23 +847,35 @@ display_set_hires_border( int colour )
 static void
 set_border( int y, int start, int end, int colour )
 {
+  static const libspectrum_byte blank[ DISPLAY_SCREEN_WIDTH_COLS ] = { 0 };
+  libspectrum_byte paper[ DISPLAY_SCREEN_WIDTH_COLS ];
   libspectrum_dword chunk_detail = colour << 11;
-  int index = start + y * DISPLAY_SCREEN_WIDTH_COLS;
+  libspectrum_dword *last_screen =
+    display_last_screen + y * DISPLAY_SCREEN_WIDTH_COLS;
+  int run = 0;
+
+  memset( paper, colour, sizeof( paper ) );
 
   for( ; start < end; start++ ) {
     /* Draw it if it is different to what was there last time - we know that
     data and mode will have been the same */
-    if( display_last_screen[ index ] != chunk_detail ) {
-      uidisplay_plot8( start, y, 0x00, 0, colour );
+    if( last_screen[ start ] != chunk_detail ) {
 
       /* Update last display record */
-      display_last_screen[ index ] = chunk_detail;
+      last_screen[ start ] = chunk_detail;
 
       /* And now mark it dirty */
       display_is_dirty[y] |= ( (libspectrum_qword)1 << start );
+
+      run++;
+
+    } else if( run ) {
+      uidisplay_plot8_run( start - run, y, run, blank, blank, paper );
+      run = 0;
     }
-    index++;
   }
+
+  if( run ) uidisplay_plot8_run( end - run, y, run, blank, blank, paper );
 }
 
 static void
@@ -915,13 +1014,21 @@ update_ui_screen( void )
 int
 display_frame( void )
 {
-  /* Copy all the critical region to the display */
-  copy_critical_region( DISPLAY_WIDTH_COLS, DISPLAY_HEIGHT - 1 );
-  critical_region_x = critical_region_y = 0;
+  if( display_suspended ) {
+    /* The whole border is compared against display_last_screen in every
+       frame shown anyway, so its changes in this one can go */
+    border_changes_last = 0;
+    add_border_sentinel();
+    uidisplay_frame_end();
+  } else {
+    /* Copy all the critical region to the display */
+    copy_critical_region( DISPLAY_WIDTH_COLS, DISPLAY_HEIGHT - 1 );
+    critical_region_x = critical_region_y = 0;
 
-  update_border();
-  update_dirty_rects();
-  update_ui_screen();
+    update_border();
+    update_dirty_rects();
+    update_ui_screen();
+  }
 
   display_frame_count++;
   if(display_frame_count==16) {
@@ -1059,3 +1166,30 @@ display_getpixel( int x, int y )
 
   return paper;
 }
+
+/* Only the flash phase needs saving; everything else is redrawn from
+   the restored memory */
+
+static size_t
+display_state_size( void )
+{
+  return 2;
+}
+
+static void
+display_state_save( libspectrum_byte **ptr )
+{
+  state_write_byte( ptr, display_frame_count );
+  state_write_byte( ptr, display_flash_reversed );
+}
+
+static void
+display_state_load( const libspectrum_byte **ptr )
+{
+  int flash_reversed = display_flash_reversed;
+
+  display_frame_count = state_read_byte( ptr );
+  display_flash_reversed = state_read_byte( ptr );
+
+  if( display_flash_reversed != flash_reversed ) display_dirty_flashing();
+}
@@ -64,6 +64,9 @@
 
 extern int display_ui_initialised;
 
+/* While set, display_frame() draws nothing; for frames being skipped */
+extern int display_suspended;
+
 extern libspectrum_byte display_lores_border;
 extern libspectrum_byte display_hires_border;
 
@@ -86,12 +89,13 @@ void display_dirty_timex( libspectrum_word offset );
 void display_dirty_pentagon_16_col( libspectrum_word offset );
 void display_dirty_sinclair( libspectrum_word offset );
 
-typedef void (*display_write_if_dirty_fn)( int x, int y );
-/* Function to write a dirty 8x1 chunk of pixels to the display */
+typedef void (*display_write_if_dirty_fn)( int x, int end, int y );
+/* Function to write the dirty 8x1 chunks of pixels from ( x, y ) up to
+   but not including ( end, y ) to the display */
 extern display_write_if_dirty_fn display_write_if_dirty;
-void display_write_if_dirty_timex( int x, int y );
-void display_write_if_dirty_pentagon_16_col( int x, int y );
-void display_write_if_dirty_sinclair( int x, int y );
+void display_write_if_dirty_timex( int x, int end, int y );
+void display_write_if_dirty_pentagon_16_col( int x, int end, int y );
+void display_write_if_dirty_sinclair( int x, int end, int y );
 
 typedef void (*display_dirty_flashing_fn)(void);
 /* Function to dirty the pixels which are changed by virtue of having a flash
@@ -31,6 +31,7 @@
 
 #include "event.h"
 #include "fuse.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "utils.h"
 
@@ -40,11 +41,42 @@ static const libspectrum_dword event_no_events = 0xffffffff;
 /* When will the next event happen? */
 libspectrum_dword event_next_event;
 
-/* The actual list of events */
-static GSList *event_list = NULL;
+/* A pending event. The events are kept in a binary heap ordered by time,
+   then type, then most recently added first (which is the order the old
+   sorted list gave). Times are absolute, counted from when the event
+   list was last reset, so the end of a frame just moves `event_epoch'
+   on rather than touching every event */
+typedef struct event_node_t {
 
-/* An event ready to be reused */
-static event_t *event_free = NULL;
+  event_t event;		/* `tstates' is only valid in event_foreach() */
+
+  libspectrum_qword time;
+  libspectrum_qword sequence;
+
+  size_t index;			/* Where this is in `event_heap' */
+  int linked_type;		/* Which type list this is on */
+
+  /* The other pending events of the same type, so they can be removed
+     without searching the heap; `next' also links the free list */
+  struct event_node_t *prev, *next;
+
+} event_node_t;
+
+static event_node_t **event_heap = NULL;
+static size_t event_count = 0, event_heap_size = 0;
+
+/* The absolute time of tstates == 0 */
+static libspectrum_qword event_epoch = 0;
+
+static libspectrum_qword event_sequence = 0;
+
+/* How many events there are with user data attached */
+static size_t event_count_with_data = 0;
+
+/* Events ready to be reused. These are never given back until the end of
+   emulation, so that the steady state (and restoring a native state) needs
+   no allocation */
+static event_node_t *event_free = NULL;
 
 /* A null event */
 int event_type_null;
@@ -52,10 +84,14 @@ int event_type_null;
 typedef struct event_descriptor_t {
   event_fn_t fn;
   char *description;
-} event_descriptor_t; 
+  event_node_t *pending;	/* Events of this type in the heap */
+} event_descriptor_t;
 
 static GArray *registered_events;
 
+#define event_descriptor( type ) \
+  ( &g_array_index( registered_events, event_descriptor_t, ( type ) ) )
+
 void
 event_init( void )
 {
@@ -73,95 +109,185 @@ event_register( event_fn_t fn, const char *description )
 
   descriptor.fn = fn;
   descriptor.description = utils_safe_strdup( description );
+  descriptor.pending = NULL;
 
   g_array_append_val( registered_events, descriptor );
 
   return registered_events->len - 1;
 }
 
-static gint
-event_add_cmp( gconstpointer a1, gconstpointer b1 )
+/* Should `a' happen before `b'? */
+static inline int
+event_before( const event_node_t *a, const event_node_t *b )
+{
+  if( a->time != b->time ) return a->time < b->time;
+  if( a->event.type != b->event.type ) return a->event.type < b->event.type;
+  return a->sequence > b->sequence;
+}
+
+static inline void
+event_heap_set( size_t index, event_node_t *node )
+{
+  event_heap[ index ] = node;
+  node->index = index;
+}
+
+static void
+event_heap_up( size_t index )
+{
+  event_node_t *node = event_heap[ index ];
+
+  while( index ) {
+    size_t parent = ( index - 1 ) / 2;
+    if( !event_before( node, event_heap[ parent ] ) ) break;
+    event_heap_set( index, event_heap[ parent ] );
+    index = parent;
+  }
+
+  event_heap_set( index, node );
+}
+
+static void
+event_heap_down( size_t index )
 {
-  const event_t *a = a1, *b = b1;
+  event_node_t *node = event_heap[ index ];
+
+  while( 1 ) {
+    size_t child = 2 * index + 1;
+    if( child >= event_count ) break;
+    if( child + 1 < event_count &&
+        event_before( event_heap[ child + 1 ], event_heap[ child ] ) )
+      child++;
+    if( !event_before( event_heap[ child ], node ) ) break;
+    event_heap_set( index, event_heap[ child ] );
+    index = child;
+  }
 
-  return a->tstates != b->tstates ? a->tstates - b->tstates
-		                  : a->type - b->type;
+  event_heap_set( index, node );
+}
+
+static void
+event_update_next( void )
+{
+  event_next_event = event_count ?
+    (libspectrum_dword)( event_heap[0]->time - event_epoch ) : event_no_events;
+}
+
+static void
+event_link( event_node_t *node )
+{
+  event_descriptor_t *descriptor = event_descriptor( node->event.type );
+
+  node->linked_type = node->event.type;
+  node->prev = NULL;
+  node->next = descriptor->pending;
+  if( node->next ) node->next->prev = node;
+  descriptor->pending = node;
+
+  if( node->event.user_data ) event_count_with_data++;
+}
+
+static void
+event_unlink( event_node_t *node )
+{
+  if( node->prev ) {
+    node->prev->next = node->next;
+  } else {
+    event_descriptor( node->linked_type )->pending = node->next;
+  }
+  if( node->next ) node->next->prev = node->prev;
+
+  if( node->event.user_data ) event_count_with_data--;
+}
+
+static void
+event_recycle( event_node_t *node )
+{
+  node->next = event_free;
+  event_free = node;
+}
+
+/* Take an event out of the heap, but don't recycle it */
+static void
+event_remove_node( event_node_t *node )
+{
+  size_t index = node->index;
+  event_node_t *last;
+
+  event_unlink( node );
+
+  last = event_heap[ --event_count ];
+  if( last != node ) {
+    event_heap_set( index, last );
+    event_heap_up( index );
+    event_heap_down( last->index );
+  }
+
+  if( !index ) event_update_next();
 }
 
 /* Add an event at the correct place in the event list */
 void
 event_add_with_data( libspectrum_dword event_time, int type, void *user_data )
 {
-  event_t *ptr;
+  event_node_t *node;
 
   if( event_free ) {
-    ptr = event_free;
-    event_free = NULL;
+    node = event_free;
+    event_free = node->next;
   } else {
-    ptr = libspectrum_malloc( sizeof( *ptr ) );
+    node = libspectrum_malloc( sizeof( *node ) );
   }
 
-  ptr->tstates = event_time;
-  ptr->type =type;
-  ptr->user_data = user_data;
-
-  if( event_time < event_next_event ) {
-    event_next_event = event_time;
-    event_list = g_slist_prepend( event_list, ptr );
-  } else {
-    event_list = g_slist_insert_sorted( event_list, ptr, event_add_cmp );
+  if( event_count == event_heap_size ) {
+    event_heap_size = event_heap_size ? 2 * event_heap_size : 32;
+    event_heap = libspectrum_realloc( event_heap,
+                                      event_heap_size * sizeof( *event_heap ) );
   }
+
+  node->event.tstates = event_time;
+  node->event.type = type;
+  node->event.user_data = user_data;
+  node->time = event_epoch + event_time;
+  node->sequence = event_sequence++;
+
+  event_link( node );
+
+  event_heap_set( event_count, node );
+  event_heap_up( event_count++ );
+
+  if( event_time < event_next_event ) event_next_event = event_time;
 }
 
 /* Do all events which have passed */
 int
 event_do_events( void )
 {
-  event_t *ptr;
+  event_node_t *node;
 
   while(event_next_event <= tstates) {
-    ptr = event_list->data;
-    event_descriptor_t descriptor =
-      g_array_index( registered_events, event_descriptor_t, ptr->type );
+    node = event_heap[0];
+    event_descriptor_t descriptor = *event_descriptor( node->event.type );
 
     /* Remove the event from the list *before* processing */
-    event_list = g_slist_remove( event_list, ptr );
-
-    if( event_list == NULL ) {
-      event_next_event = event_no_events;
-    } else {
-      event_next_event = ((event_t*)(event_list->data))->tstates;
-    }
+    event_remove_node( node );
 
-    if( descriptor.fn ) descriptor.fn( ptr->tstates, ptr->type, ptr->user_data );
+    if( descriptor.fn )
+      descriptor.fn( node->time - event_epoch, node->event.type,
+                     node->event.user_data );
 
-    if( event_free ) {
-      libspectrum_free( ptr );
-    } else {
-      event_free = ptr;
-    }
+    event_recycle( node );
   }
 
   return 0;
 }
 
-static void
-event_reduce_tstates( gpointer data, gpointer user_data )
-{
-  event_t *ptr = data;
-  libspectrum_dword *tstates_per_frame = user_data;
-
-  ptr->tstates -= *tstates_per_frame;
-}
-
 /* Called at end of frame to reduce T-state count of all entries */
 void
 event_frame( libspectrum_dword tstates_per_frame )
 {
-  g_slist_foreach( event_list, event_reduce_tstates, &tstates_per_frame );
-
-  event_next_event = event_list ?
-    ((event_t*)(event_list->data))->tstates : event_no_events;
+  event_epoch += tstates_per_frame;
+  event_update_next();
 }
 
 /* Do all events that would happen between the current time and when
@@ -174,76 +300,182 @@ event_force_events( void )
 
     /* Jump along to the next event */
     tstates = event_next_event;
-    
+
     /* And do that event */
     event_do_events();
 
   }
 }
 
-static void
-set_event_null( gpointer data, gpointer user_data )
+/* Remove all events of a specific type from the stack */
+void
+event_remove_type( int type )
 {
-  event_t *ptr = data;
-  int *type = user_data;
+  event_node_t *node;
 
-  if( ptr->type == *type ) ptr->type = event_type_null;
+  while( ( node = event_descriptor( type )->pending ) ) {
+    event_remove_node( node );
+    event_recycle( node );
+  }
 }
 
-static void
-set_event_null_with_user_data( gpointer data, gpointer user_data )
+/* Remove all events of a specific type and user data from the stack */
+void
+event_remove_type_user_data( int type, gpointer user_data )
 {
-  event_t *event = data;
-  event_t *template = user_data;
+  event_node_t *node, *next;
 
-  if( event->type == template->type && event->user_data == template->user_data )
-    event->type = event_type_null;
+  for( node = event_descriptor( type )->pending; node; node = next ) {
+    next = node->next;
+    if( node->event.user_data != user_data ) continue;
+    event_remove_node( node );
+    event_recycle( node );
+  }
 }
 
-/* Remove all events of a specific type from the stack */
+/* Clear the event stack */
 void
-event_remove_type( int type )
+event_reset( void )
 {
-  g_slist_foreach( event_list, set_event_null, &type );
+  size_t i;
+
+  for( i = 0; i < event_count; i++ ) event_recycle( event_heap[i] );
+  event_count = 0;
+  event_count_with_data = 0;
+
+  for( i = 0; i < registered_events->len; i++ )
+    event_descriptor( i )->pending = NULL;
+
+  event_epoch = 0;
+  event_sequence = 0;
+
+  event_next_event = event_no_events;
 }
 
-/* Remove all events of a specific type and user data from the stack */
+/* Call a user-supplied function for every event in the current list */
 void
-event_remove_type_user_data( int type, gpointer user_data )
+event_foreach( GFunc function, gpointer user_data )
 {
-  event_t template;
+  size_t i, count;
+  int changed = 0;
+
+  for( i = 0; i < event_count; i++ ) {
+    event_node_t *node = event_heap[i];
+    node->event.tstates = node->time - event_epoch;
+    function( &node->event, user_data );
+    if( node->event.type != node->linked_type ) changed = 1;
+  }
+
+  if( !changed ) return;
+
+  /* The debugger removes events by making them null; drop those, move any
+     others onto their new type's list and then rebuild the heap */
+  for( i = 0, count = 0; i < event_count; i++ ) {
+    event_node_t *node = event_heap[i];
+    int type = node->event.type;
+
+    if( type != node->linked_type ) {
+      event_unlink( node );
+      if( type == event_type_null ) {
+        event_recycle( node );
+        continue;
+      }
+      event_link( node );
+    }
 
-  template.type = type;
-  template.user_data = user_data;
-  g_slist_foreach( event_list, set_event_null_with_user_data, &template );
+    event_heap_set( count++, node );
+  }
+
+  event_count = count;
+  for( i = event_count / 2; i > 0; i-- ) event_heap_down( i - 1 );
+  event_update_next();
 }
 
-/* Free the memory used by a specific entry */
-static void
-event_free_entry( gpointer data, gpointer user_data GCC_UNUSED )
+/* The most events we'll put into a native state */
+#define EVENT_STATE_MAX 64
+
+int
+event_state_available( void )
 {
-  libspectrum_free( data );
+  /* Events with user data point at in-memory structures, so can't be
+     saved */
+  return event_count <= EVENT_STATE_MAX && !event_count_with_data;
+}
+
+size_t
+event_state_size( void )
+{
+  return 4 + EVENT_STATE_MAX * 8;
 }
 
-/* Clear the event stack */
 void
-event_reset( void )
+event_state_save( libspectrum_byte **ptr )
 {
-  g_slist_foreach( event_list, event_free_entry, NULL );
-  g_slist_free( event_list );
-  event_list = NULL;
+  event_node_t *sorted[ EVENT_STATE_MAX ];
+  libspectrum_dword count = 0;
+  size_t i, j;
 
-  event_next_event = event_no_events;
+  /* Write the events in the order they'll happen */
+  for( i = 0; i < event_count; i++ ) {
+    event_node_t *node = event_heap[i];
 
-  libspectrum_free( event_free );
-  event_free = NULL;
+    if( node->event.type == event_type_null ) continue;
+    if( count == EVENT_STATE_MAX ) break;
+
+    for( j = count; j && event_before( node, sorted[ j - 1 ] ); j-- )
+      sorted[j] = sorted[ j - 1 ];
+    sorted[j] = node;
+    count++;
+  }
+
+  state_write_dword( ptr, count );
+  for( i = 0; i < count; i++ ) {
+    state_write_dword( ptr, sorted[i]->time - event_epoch );
+    state_write_dword( ptr, sorted[i]->event.type );
+  }
+}
+
+/* Returns the length of the event section at `ptr', or 0 if it is not
+   valid */
+size_t
+event_state_check( const libspectrum_byte *ptr, size_t length )
+{
+  libspectrum_dword i, count;
+
+  if( length < 4 ) return 0;
+  count = state_read_dword( &ptr );
+
+  if( count > EVENT_STATE_MAX || length - 4 < count * 8 ) return 0;
+
+  for( i = 0; i < count; i++ ) {
+    state_read_dword( &ptr );
+    if( state_read_dword( &ptr ) >= registered_events->len ) return 0;
+  }
+
+  return 4 + count * 8;
 }
 
-/* Call a user-supplied function for every event in the current list */
 void
-event_foreach( GFunc function, gpointer user_data )
+event_state_load( const libspectrum_byte **ptr )
 {
-  g_slist_foreach( event_list, function, user_data );
+  libspectrum_dword count;
+  const libspectrum_byte *entry;
+
+  event_reset();
+
+  count = state_read_dword( ptr );
+
+  /* Add them last first, so that simultaneous events come out in the
+     same order as they were saved */
+  for( entry = *ptr + count * 8; entry != *ptr; ) {
+    const libspectrum_byte *read = entry -= 8;
+    libspectrum_dword event_time = state_read_dword( &read );
+    int type = state_read_dword( &read );
+
+    event_add( event_time, type );
+  }
+
+  *ptr += count * 8;
 }
 
 /* A textual representation of each event type */
@@ -274,6 +506,18 @@ registered_events_free( void )
 void
 event_end( void )
 {
+  event_node_t *node;
+
   event_reset();
+
+  while( ( node = event_free ) ) {
+    event_free = node->next;
+    libspectrum_free( node );
+  }
+
+  libspectrum_free( event_heap );
+  event_heap = NULL;
+  event_heap_size = 0;
+
   registered_events_free();
 }
@@ -85,6 +85,13 @@ void event_reset( void );
 /* Call a user-supplied function for every event in the current list */
 void event_foreach( GFunc function, gpointer user_data );
 
+/* Native savestate support; see state.h */
+int event_state_available( void );
+size_t event_state_size( void );
+void event_state_save( libspectrum_byte **ptr );
+size_t event_state_check( const libspectrum_byte *ptr, size_t length );
+void event_state_load( const libspectrum_byte **ptr );
+
 /* A textual representation of each event type */
 const char *event_name( int type );
 
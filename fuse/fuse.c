@@ -56,6 +56,7 @@
 #include "event.h"
 #include "fuse.h"
 #include "keyboard.h"
+#include "loader.h"
 #include "machine.h"
 #include "machines/machines_periph.h"
 #include "memory.h"
@@ -265,6 +266,11 @@ static int fuse_init(int argc, char **argv)
 #endif				/* #ifdef HAVE_GETEUID */
 
   mempool_init();
+
+  /* Before the other modules, so a state gives the T-state count back
+     before anything which times a change by it (the border, the beeper) */
+  z80_init();
+
   memory_init();
 
   debugger_init();
@@ -297,8 +303,6 @@ static int fuse_init(int argc, char **argv)
   spectranet_init();
   machines_periph_init();
 
-  z80_init();
-
   if( timer_init() ) return 1;
 
   error = timer_estimate_reset(); if( error ) return error;
@@ -310,6 +314,7 @@ static int fuse_init(int argc, char **argv)
   if( error ) return error;
 
   tape_init();
+  loader_init();
 
   error = scaler_select_id( start_scaler ); libspectrum_free( start_scaler );
   if( error ) return error;
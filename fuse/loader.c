@@ -28,8 +28,10 @@
 #include "event.h"
 #include "loader.h"
 #include "memory.h"
+#include "module.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "state.h"
 #include "tape.h"
 #include "z80/z80.h"
 
@@ -48,6 +50,29 @@ typedef enum acceleration_mode_t {
 static acceleration_mode_t acceleration_mode;
 static size_t acceleration_pc;
 
+static size_t loader_state_size( void );
+static void loader_state_save( libspectrum_byte **ptr );
+static void loader_state_load( const libspectrum_byte **ptr );
+
+static module_info_t loader_module_info = {
+
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  loader_state_size,
+  loader_state_save,
+  loader_state_load,
+
+};
+
+void
+loader_init( void )
+{
+  module_register( &loader_module_info );
+}
+
 void
 loader_frame( libspectrum_dword frame_length )
 {
@@ -364,3 +389,40 @@ loader_set_acceleration_flags( int flags )
     length_known2 = 0;
   }
 }
+
+/* Whether the tape gets started or stopped depends on what the loader
+   has been doing, so this has to go with the rest of the machine */
+
+static size_t
+loader_state_size( void )
+{
+  return 4 + 4 + 1 + 4 + 1 + 2;
+}
+
+static void
+loader_state_save( libspectrum_byte **ptr )
+{
+  state_write_dword( ptr, successive_reads );
+  state_write_dword( ptr, last_tstates_read );
+  state_write_byte( ptr, last_b_read );
+  state_write_byte( ptr, length_known1 );
+  state_write_byte( ptr, length_known2 );
+  state_write_byte( ptr, length_long1 );
+  state_write_byte( ptr, length_long2 );
+  state_write_byte( ptr, acceleration_mode );
+  state_write_word( ptr, acceleration_pc );
+}
+
+static void
+loader_state_load( const libspectrum_byte **ptr )
+{
+  successive_reads = state_read_dword( ptr );
+  last_tstates_read = (libspectrum_signed_dword)state_read_dword( ptr );
+  last_b_read = state_read_byte( ptr );
+  length_known1 = state_read_byte( ptr );
+  length_known2 = state_read_byte( ptr );
+  length_long1 = state_read_byte( ptr );
+  length_long2 = state_read_byte( ptr );
+  acceleration_mode = state_read_byte( ptr );
+  acceleration_pc = state_read_word( ptr );
+}
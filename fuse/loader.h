@@ -28,6 +28,7 @@
 
 #include <libspectrum.h>
 
+void loader_init( void );
 void loader_frame( libspectrum_dword frame_length );
 void loader_tape_play( void );
 void loader_tape_stop( void );
@@ -359,6 +359,7 @@ machine_reset( int hard_reset )
     ula_contention[ i ] = machine_current->ram.contend_delay( i );
     ula_contention_no_mreq[ i ] = machine_current->ram.contend_delay_no_mreq( i );
   }
+  ula_contention_update();
 
   /* Update the disk menu items */
   ui_menu_disk_update();
@@ -41,6 +41,7 @@
 #include "peripherals/ula.h"
 #include "settings.h"
 #include "spectrum.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "utils.h"
 
@@ -59,6 +60,10 @@ int memory_source_none; /* No memory attached here */
 memory_page memory_map_read[MEMORY_PAGES_IN_64K];
 memory_page memory_map_write[MEMORY_PAGES_IN_64K];
 
+/* The parts of those the Z80 core uses on every access */
+memory_hot_page memory_map_hot_read[MEMORY_PAGES_IN_64K];
+memory_hot_page memory_map_hot_write[MEMORY_PAGES_IN_64K];
+
 /* Standard mappings for the 'normal' RAM */
 memory_page memory_map_ram[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
 
@@ -74,6 +79,12 @@ typedef struct memory_pool_entry_t {
 /* All the memory we've allocated for this machine */
 static GSList *pool;
 
+/* Which peripherals need to see memory accesses */
+int memory_hooks = 0;
+
+/* Which RAM pages have been written to */
+libspectrum_byte memory_ram_dirty[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
+
 /* Which RAM page contains the current screen */
 int memory_current_screen;
 
@@ -82,6 +93,9 @@ libspectrum_word memory_screen_mask;
 
 static void memory_from_snapshot( libspectrum_snap *snap );
 static void memory_to_snapshot( libspectrum_snap *snap );
+static size_t memory_state_size( void );
+static void memory_state_save( libspectrum_byte **ptr );
+static void memory_state_load( const libspectrum_byte **ptr );
 
 static module_info_t memory_module_info = {
 
@@ -90,6 +104,9 @@ static module_info_t memory_module_info = {
   NULL,
   memory_from_snapshot,
   memory_to_snapshot,
+  memory_state_size,
+  memory_state_save,
+  memory_state_load,
 
 };
 
@@ -257,6 +274,42 @@ memory_ram_set_16k_contention( int page_num, int contended )
     memory_map_ram[ page_num * MEMORY_PAGES_IN_16K + i ].contended = contended;
 }
 
+/* Mark 16K of RAM as written to */
+void
+memory_ram_set_16k_dirty( int page_num )
+{
+  int i;
+
+  for( i = 0; i < MEMORY_PAGES_IN_16K; i++ )
+    memory_ram_dirty[ page_num * MEMORY_PAGES_IN_16K + i ] =
+      MEMORY_RAM_DIRTY_ALL;
+}
+
+static inline void
+hot_copy( memory_hot_page *hot, const memory_page *page )
+{
+  hot->page = page->page;
+  hot->contended = page->contended ? 1 : 0;
+  hot->writable = page->writable ? 1 : 0;
+}
+
+void
+memory_map_hot_update( int page_num )
+{
+  hot_copy( &memory_map_hot_read[ page_num ], &memory_map_read[ page_num ] );
+  hot_copy( &memory_map_hot_write[ page_num ],
+            &memory_map_write[ page_num ] );
+}
+
+/* Map `source' into both the read and write maps at `page_num' */
+static inline void
+map_page( int page_num, const memory_page *source )
+{
+  memory_map_read[ page_num ] = memory_map_write[ page_num ] = *source;
+  hot_copy( &memory_map_hot_read[ page_num ], source );
+  memory_map_hot_write[ page_num ] = memory_map_hot_read[ page_num ];
+}
+
 /* Map 16K of memory */
 void
 memory_map_16k( libspectrum_word address, memory_page source[], int page_num )
@@ -265,8 +318,7 @@ memory_map_16k( libspectrum_word address, memory_page source[], int page_num )
 
   for( i = 0; i < MEMORY_PAGES_IN_16K; i++ ) {
     int page = ( address >> MEMORY_PAGE_SIZE_LOGARITHM ) + i;
-    memory_map_read[ page ] = memory_map_write[ page ] =
-      source[ page_num * MEMORY_PAGES_IN_16K + i ];
+    map_page( page, &source[ page_num * MEMORY_PAGES_IN_16K + i ] );
   }
 }
 
@@ -278,8 +330,7 @@ memory_map_8k( libspectrum_word address, memory_page source[], int page_num )
 
   for( i = 0; i < MEMORY_PAGES_IN_8K; i++ ) {
     int page = ( address >> MEMORY_PAGE_SIZE_LOGARITHM ) + i;
-    memory_map_read[ page ] = memory_map_write[ page ] =
-      source[ page_num * MEMORY_PAGES_IN_8K + i ];
+    map_page( page, &source[ page_num * MEMORY_PAGES_IN_8K + i ] );
   }
 }
 
@@ -287,8 +338,7 @@ memory_map_8k( libspectrum_word address, memory_page source[], int page_num )
 void
 memory_map_page( memory_page *source[], int page_num )
 {
-  memory_map_read[ page_num ] = memory_map_write[ page_num ] =
-    *source[ page_num ];
+  map_page( page_num, source[ page_num ] );
 }
 
 /* Page in from /ROMCS */
@@ -298,7 +348,7 @@ memory_map_romcs( memory_page source[] )
   int i;
 
   for( i = 0; i < MEMORY_PAGES_IN_16K; i++ )
-    memory_map_read[i] = memory_map_write[i] = source[i];
+    map_page( i, &source[i] );
 }
 
 /* Page in 8K from /ROMCS */
@@ -309,7 +359,7 @@ memory_map_romcs_8k( libspectrum_word address, memory_page source[] )
 
   start = address >> MEMORY_PAGE_SIZE_LOGARITHM;
   for( i = 0; i < MEMORY_PAGES_IN_8K; i++ )
-    memory_map_read[ start + i ] = memory_map_write[ start + i ] = source[ i ];
+    map_page( start + i, &source[ i ] );
 }
 
 /* Page in 4K from /ROMCS */
@@ -320,17 +370,17 @@ memory_map_romcs_4k( libspectrum_word address, memory_page source[] )
 
   start = address >> MEMORY_PAGE_SIZE_LOGARITHM;
   for( i = 0; i < MEMORY_PAGES_IN_4K; i++ )
-    memory_map_read[ start + i ] = memory_map_write[ start + i ] = source[ i ];
+    map_page( start + i, &source[ i ] );
 }
 
 libspectrum_byte
 readbyte( libspectrum_word address )
 {
   libspectrum_word bank;
-  memory_page *mapping;
+  memory_hot_page *mapping;
 
   bank = address >> MEMORY_PAGE_SIZE_LOGARITHM;
-  mapping = &memory_map_read[ bank ];
+  mapping = &memory_map_hot_read[ bank ];
 
   if( debugger_mode != DEBUGGER_MODE_INACTIVE )
     debugger_check( DEBUGGER_BREAKPOINT_TYPE_READ, address );
@@ -338,14 +388,18 @@ readbyte( libspectrum_word address )
   if( mapping->contended ) tstates += ula_contention[ tstates ];
   tstates += 3;
 
-  if( opus_active && address >= 0x2800 && address < 0x3800 )
-    return opus_read( address );
-
-  if( spectranet_paged ) {
-    if( spectranet_w5100_paged_a && address >= 0x1000 && address < 0x2000 )
-      return spectranet_w5100_read( mapping, address );
-    if( spectranet_w5100_paged_b && address >= 0x2000 && address < 0x3000 )
-      return spectranet_w5100_read( mapping, address );
+  if( memory_hooks ) {
+    if( opus_active && address >= 0x2800 && address < 0x3800 )
+      return opus_read( address );
+
+    if( spectranet_paged ) {
+      if( spectranet_w5100_paged_a && address >= 0x1000 && address < 0x2000 )
+        return spectranet_w5100_read( &memory_map_read[ bank ],
+                                      address );
+      if( spectranet_w5100_paged_b && address >= 0x2000 && address < 0x3000 )
+        return spectranet_w5100_read( &memory_map_read[ bank ],
+                                      address );
+    }
   }
 
   return mapping->page[ address & MEMORY_PAGE_SIZE_MASK ];
@@ -355,15 +409,14 @@ void
 writebyte( libspectrum_word address, libspectrum_byte b )
 {
   libspectrum_word bank;
-  memory_page *mapping;
 
   bank = address >> MEMORY_PAGE_SIZE_LOGARITHM;
-  mapping = &memory_map_write[ bank ];
 
   if( debugger_mode != DEBUGGER_MODE_INACTIVE )
     debugger_check( DEBUGGER_BREAKPOINT_TYPE_WRITE, address );
 
-  if( mapping->contended ) tstates += ula_contention[ tstates ];
+  if( memory_map_hot_write[ bank ].contended )
+    tstates += ula_contention[ tstates ];
 
   tstates += 3;
 
@@ -420,40 +473,92 @@ memory_display_dirty_sinclair( libspectrum_word address, libspectrum_byte b ) \
 
 memory_display_dirty_fn memory_display_dirty;
 
+/* RAM page `page' (in MEMORY_PAGE_SIZE units) is about to be overwritten
+   with `data' other than by the Z80: redraw whatever that changes on the
+   current screen, as the memory_display_dirty_*() functions do for each
+   write */
 void
-writebyte_internal( libspectrum_word address, libspectrum_byte b )
+memory_display_dirty_ram( size_t page, const libspectrum_byte *data )
+{
+  memory_page *mapping = &memory_map_ram[ page ];
+  libspectrum_word mask = memory_screen_mask, offset;
+  size_t i;
+
+  if( memory_display_dirty == memory_display_dirty_pentagon_16_col ) {
+    /* Screen 1 is in pages 5 and 4, screen 2 in pages 7 and 6 */
+    if( ( mapping->page_num | 1 ) != memory_current_screen ) return;
+    mask = 0xdfff;
+  } else if( mapping->page_num != memory_current_screen ) {
+    return;
+  }
+
+  for( i = 0; i < MEMORY_PAGE_SIZE; i++ ) {
+    offset = mapping->offset + i;
+    if( ( offset & mask ) < 0x1b00 && mapping->page[ i ] != data[ i ] )
+      display_dirty( offset );
+  }
+}
+
+/* Write to whatever is mapped at `address', with no peripheral looking */
+static inline void
+write_mapped( libspectrum_word address, libspectrum_byte b )
 {
   libspectrum_word bank = address >> MEMORY_PAGE_SIZE_LOGARITHM;
   memory_page *mapping = &memory_map_write[ bank ];
-  
-  if( spectranet_paged ) {
-    /* all writes need to be parsed by the flash rom emulation */
-    spectranet_flash_rom_write(address, b);
-    
-    if( spectranet_w5100_paged_a && address >= 0x1000 && address < 0x2000 ) {
-      spectranet_w5100_write( mapping, address, b );
-      return;
-    }
-    if( spectranet_w5100_paged_b && address >= 0x2000 && address < 0x3000 ) {
-      spectranet_w5100_write( mapping, address, b );
-      return;
-    }
-  }
 
-  if( opus_active && address >= 0x2800 && address < 0x3800 ) {
-    opus_write( address, b );
-  } else if( mapping->writable ||
-             (mapping->source != memory_source_none &&
-              settings_current.writable_roms) ) {
+  if( memory_map_hot_write[ bank ].writable ||
+      (mapping->source != memory_source_none &&
+       settings_current.writable_roms) ) {
     libspectrum_word offset = address & MEMORY_PAGE_SIZE_MASK;
-    libspectrum_byte *memory = mapping->page;
+    libspectrum_byte *memory = memory_map_hot_write[ bank ].page;
 
     memory_display_dirty( address, b );
 
+    if( mapping->source == memory_source_ram )
+      memory_ram_set_dirty( mapping->page_num, mapping->offset );
+
     memory[ offset ] = b;
   }
 }
 
+void
+writebyte_internal( libspectrum_word address, libspectrum_byte b )
+{
+  if( memory_hooks ) {
+    libspectrum_word bank = address >> MEMORY_PAGE_SIZE_LOGARITHM;
+    memory_page *mapping = &memory_map_write[ bank ];
+
+    if( spectranet_paged ) {
+      /* all writes need to be parsed by the flash rom emulation */
+      spectranet_flash_rom_write(address, b);
+
+      if( spectranet_w5100_paged_a && address >= 0x1000 &&
+          address < 0x2000 ) {
+        spectranet_w5100_write( mapping, address, b );
+        return;
+      }
+      if( spectranet_w5100_paged_b && address >= 0x2000 &&
+          address < 0x3000 ) {
+        spectranet_w5100_write( mapping, address, b );
+        return;
+      }
+    }
+
+    if( opus_active && address >= 0x2800 && address < 0x3800 ) {
+      opus_write( address, b );
+      return;
+    }
+  }
+
+  write_mapped( address, b );
+}
+
+void
+writebyte_unhooked( libspectrum_word address, libspectrum_byte b )
+{
+  write_mapped( address, b );
+}
+
 void
 memory_romcs_map( void )
 {
@@ -504,8 +609,10 @@ memory_from_snapshot( libspectrum_snap *snap )
   }
 
   for( i = 0; i < 64; i++ )
-    if( libspectrum_snap_pages( snap, i ) )
+    if( libspectrum_snap_pages( snap, i ) ) {
       memcpy( RAM[i], libspectrum_snap_pages( snap, i ), 0x4000 );
+      memory_ram_set_16k_dirty( i );
+    }
 
   if( libspectrum_snap_custom_rom( snap ) ) {
     for( i = 0; i < libspectrum_snap_custom_rom_pages( snap ) && i < 4; i++ ) {
@@ -619,3 +726,143 @@ memory_to_snapshot( libspectrum_snap *snap )
 
   memory_rom_to_snapshot( snap );
 }
+
+/* The paging registers; the mappings themselves are rebuilt from these
+   once every module has been restored */
+
+static size_t
+memory_state_size( void )
+{
+  return 3;
+}
+
+static void
+memory_state_save( libspectrum_byte **ptr )
+{
+  state_write_byte( ptr, machine_current->ram.last_byte );
+  state_write_byte( ptr, machine_current->ram.last_byte2 );
+  state_write_byte( ptr, machine_current->ram.locked );
+}
+
+static void
+memory_state_load( const libspectrum_byte **ptr )
+{
+  int capabilities = machine_current->capabilities;
+  libspectrum_byte last_byte = state_read_byte( ptr );
+  libspectrum_byte last_byte2 = state_read_byte( ptr );
+  int locked = state_read_byte( ptr );
+
+  /* Go through the port handlers as they also select the screen and, on
+     the Pentagon 1024, the display mode */
+  machine_current->ram.locked = 0;
+
+  if( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_PENT1024_MEMORY ) {
+    pentagon1024_memoryport_write( 0x7ffd, last_byte );
+    pentagon1024_v22_memoryport_write( 0xeff7, last_byte2 );
+  } else {
+    if( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_128_MEMORY )
+      spec128_memoryport_write( 0x7ffd, last_byte );
+
+    if( ( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_PLUS3_MEMORY ) ||
+        ( capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_SCORP_MEMORY )    )
+      specplus3_memoryport2_write( 0x1ffd, last_byte2 );
+  }
+
+  machine_current->ram.last_byte = last_byte;
+  machine_current->ram.last_byte2 = last_byte2;
+  machine_current->ram.locked = locked;
+}
+
+/* RAM is stored as a count followed by (index, data) for every 4Kb page
+   which might be non-zero; anything else is known to be still clear.
+   Only pages the current machine can reach are considered */
+
+size_t
+memory_state_ram_pages( void )
+{
+  size_t pages = machine_current->ram.valid_pages;
+
+  if( pages < 8 ) pages = 8;
+  if( pages > SPECTRUM_RAM_PAGES ) pages = SPECTRUM_RAM_PAGES;
+
+  return pages * MEMORY_PAGES_IN_16K;
+}
+
+/* The most space the RAM could need, rather than what it needs now, so
+   that the frontend sees the same size all the time */
+size_t
+memory_state_ram_size( void )
+{
+  return 4 + memory_state_ram_pages() * ( 2 + MEMORY_PAGE_SIZE );
+}
+
+void
+memory_state_ram_save( libspectrum_byte **ptr )
+{
+  size_t i, pages = memory_state_ram_pages();
+  libspectrum_dword count = 0;
+  libspectrum_byte *count_ptr = *ptr;
+
+  *ptr += 4;
+
+  for( i = 0; i < pages; i++ ) {
+    if( !( memory_ram_dirty[i] & MEMORY_RAM_DIRTY_TOUCHED ) ) continue;
+
+    state_write_word( ptr, i );
+    state_write_block( ptr, memory_map_ram[i].page, MEMORY_PAGE_SIZE );
+    count++;
+  }
+
+  state_write_dword( &count_ptr, count );
+}
+
+/* Returns the length of the RAM section at `ptr', or 0 if it is not
+   valid */
+size_t
+memory_state_ram_check( const libspectrum_byte *ptr, size_t length )
+{
+  libspectrum_dword i, count;
+  size_t pages = memory_state_ram_pages();
+
+  if( length < 4 ) return 0;
+  count = state_read_dword( &ptr );
+
+  if( count > pages || length - 4 < count * ( 2 + MEMORY_PAGE_SIZE ) )
+    return 0;
+
+  for( i = 0; i < count; i++ ) {
+    if( state_read_word( &ptr ) >= pages ) return 0;
+    ptr += MEMORY_PAGE_SIZE;
+  }
+
+  return 4 + count * ( 2 + MEMORY_PAGE_SIZE );
+}
+
+void
+memory_state_ram_load( const libspectrum_byte **ptr )
+{
+  libspectrum_byte present[ SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K ];
+  size_t i, pages = memory_state_ram_pages();
+  libspectrum_dword count;
+
+  memset( present, 0, pages );
+
+  count = state_read_dword( ptr );
+  for( i = 0; i < count; i++ ) {
+    libspectrum_word page = state_read_word( ptr );
+
+    state_read_block( ptr, memory_map_ram[ page ].page, MEMORY_PAGE_SIZE );
+    memory_ram_dirty[ page ] = MEMORY_RAM_DIRTY_ALL;
+    present[ page ] = 1;
+  }
+
+  /* Anything we've written to since which wasn't in the state must have
+     been clear when it was taken */
+  for( i = 0; i < pages; i++ ) {
+    if( present[i] || !( memory_ram_dirty[i] & MEMORY_RAM_DIRTY_TOUCHED ) )
+      continue;
+
+    memset( memory_map_ram[i].page, 0, MEMORY_PAGE_SIZE );
+    memory_ram_dirty[i] = MEMORY_RAM_DIRTY_ALL & ~MEMORY_RAM_DIRTY_TOUCHED;
+  }
+}
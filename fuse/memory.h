@@ -89,6 +89,32 @@ typedef struct memory_page {
 extern memory_page memory_map_read[MEMORY_PAGES_IN_64K];
 extern memory_page memory_map_write[MEMORY_PAGES_IN_64K];
 
+/* The parts of a memory_page needed on every memory access. The maps of
+   these for the whole 64K take four cache lines each, rather than the
+   ten of memory_map_read[] or memory_map_write[], and leave out source,
+   page_num and offset. Kept in step with the full maps by the memory_map_*
+   functions; anything which writes to the full maps itself must call
+   memory_map_hot_update() afterwards */
+typedef struct memory_hot_page {
+
+  libspectrum_byte *page;	/* As in memory_page */
+  libspectrum_byte contended;
+  libspectrum_byte writable;
+
+} memory_hot_page;
+
+extern memory_hot_page memory_map_hot_read[MEMORY_PAGES_IN_64K];
+extern memory_hot_page memory_map_hot_write[MEMORY_PAGES_IN_64K];
+
+/* Are accesses to `address' contended? */
+#define memory_hot_read_contended( address ) \
+  memory_map_hot_read[ (libspectrum_word)(address) >> MEMORY_PAGE_SIZE_LOGARITHM ].contended
+#define memory_hot_write_contended( address ) \
+  memory_map_hot_write[ (libspectrum_word)(address) >> MEMORY_PAGE_SIZE_LOGARITHM ].contended
+
+/* Copy page `page_num' of the full maps into the hot ones */
+void memory_map_hot_update( int page_num );
+
 /* The number of 16Kb RAM pages we support: 1040 Kb needed for the Pentagon 1024 */
 #define SPECTRUM_RAM_PAGES 65
 
@@ -98,6 +124,36 @@ extern memory_page memory_map_write[MEMORY_PAGES_IN_64K];
 extern memory_page memory_map_ram[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
 extern memory_page memory_map_rom[SPECTRUM_ROM_PAGES * MEMORY_PAGES_IN_16K];
 
+/* Which 4Kb RAM pages have been written to. Writers set every bit;
+   each consumer owns one bit and clears it once it has seen the change */
+extern libspectrum_byte
+  memory_ram_dirty[SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K];
+
+/* The page may differ from its power-on (all zero) contents */
+#define MEMORY_RAM_DIRTY_TOUCHED 0x01
+
+/* The page has changed since rollback.c last looked at it */
+#define MEMORY_RAM_DIRTY_ROLLBACK 0x02
+
+/* The page has changed since rewind.c last looked at it */
+#define MEMORY_RAM_DIRTY_REWIND 0x04
+
+#define MEMORY_RAM_DIRTY_ALL 0xff
+
+/* Note a write to a RAM page done without going through writebyte() */
+#define memory_ram_set_dirty( page_num, offset ) \
+  memory_ram_dirty[ (page_num) * MEMORY_PAGES_IN_16K + \
+    ( ( (offset) & 0x3fff ) >> MEMORY_PAGE_SIZE_LOGARITHM ) ] = \
+    MEMORY_RAM_DIRTY_ALL
+
+/* Peripherals which need to see some memory accesses for themselves.
+   While none of these are set, readbyte() and writebyte_internal() can go
+   straight to the memory map */
+extern int memory_hooks;
+
+#define MEMORY_HOOK_OPUS       0x01 /* Opus Discovery RAM and I/O paged */
+#define MEMORY_HOOK_SPECTRANET 0x02 /* Spectranet paged */
+
 /* Which RAM page contains the current screen */
 extern int memory_current_screen;
 
@@ -124,6 +180,9 @@ void memory_reset( void );
 /* Set contention for 16K of RAM */
 void memory_ram_set_16k_contention( int page_num, int contended );
 
+/* Mark 16K of RAM as written to */
+void memory_ram_set_16k_dirty( int page_num );
+
 /* Map 16K of memory */
 void memory_map_16k( libspectrum_word address, memory_page source[],
   int page_num );
@@ -152,7 +211,7 @@ libspectrum_byte readbyte( libspectrum_word address );
 #ifndef CORETEST
 
 #define readbyte_internal( address ) \
-  memory_map_read[ (libspectrum_word)(address) >> MEMORY_PAGE_SIZE_LOGARITHM ].page[ (address) & MEMORY_PAGE_SIZE_MASK ]
+  memory_map_hot_read[ (libspectrum_word)(address) >> MEMORY_PAGE_SIZE_LOGARITHM ].page[ (address) & MEMORY_PAGE_SIZE_MASK ]
 
 #else				/* #ifndef CORETEST */
 
@@ -163,12 +222,23 @@ libspectrum_byte readbyte_internal( libspectrum_word address );
 void writebyte( libspectrum_word address, libspectrum_byte b );
 void writebyte_internal( libspectrum_word address, libspectrum_byte b );
 
+/* writebyte_internal() for when memory_hooks is clear */
+void writebyte_unhooked( libspectrum_word address, libspectrum_byte b );
+
 typedef void (*memory_display_dirty_fn)( libspectrum_word address,
                                          libspectrum_byte b );
 extern memory_display_dirty_fn memory_display_dirty;
 
 void memory_display_dirty_sinclair( libspectrum_word address,
                                     libspectrum_byte b );
+void memory_display_dirty_ram( size_t page, const libspectrum_byte *data );
+/* Native savestate support for the RAM contents; see state.h */
+size_t memory_state_ram_pages( void );
+size_t memory_state_ram_size( void );
+void memory_state_ram_save( libspectrum_byte **ptr );
+size_t memory_state_ram_check( const libspectrum_byte *ptr, size_t length );
+void memory_state_ram_load( const libspectrum_byte **ptr );
+
 void memory_display_dirty_pentagon_16_col( libspectrum_word address,
                                            libspectrum_byte b );
 
@@ -124,3 +124,52 @@ module_snapshot_to( libspectrum_snap *snap )
 {
   g_slist_foreach( registered_modules, snapshot_to, snap );
 }
+
+static void
+state_size( gpointer data, gpointer user_data )
+{
+  const module_info_t *module = data;
+  size_t *size = user_data;
+
+  if( module->state_size ) *size += module->state_size();
+}
+
+size_t
+module_state_size( void )
+{
+  size_t size = 0;
+
+  g_slist_foreach( registered_modules, state_size, &size );
+
+  return size;
+}
+
+static void
+state_save( gpointer data, gpointer user_data )
+{
+  const module_info_t *module = data;
+  libspectrum_byte **ptr = user_data;
+
+  if( module->state_save ) module->state_save( ptr );
+}
+
+void
+module_state_save( libspectrum_byte **ptr )
+{
+  g_slist_foreach( registered_modules, state_save, ptr );
+}
+
+static void
+state_load( gpointer data, gpointer user_data )
+{
+  const module_info_t *module = data;
+  const libspectrum_byte **ptr = user_data;
+
+  if( module->state_load ) module->state_load( ptr );
+}
+
+void
+module_state_load( const libspectrum_byte **ptr )
+{
+  g_slist_foreach( registered_modules, state_load, (gpointer)ptr );
+}
@@ -33,6 +33,9 @@ typedef void (*module_romcs_fn)( void );
 typedef void (*module_snapshot_enabled_fn)( libspectrum_snap *snap );
 typedef void (*module_snapshot_from_fn)( libspectrum_snap *snap );
 typedef void (*module_snapshot_to_fn)( libspectrum_snap *snap );
+typedef size_t (*module_state_size_fn)( void );
+typedef void (*module_state_save_fn)( libspectrum_byte **ptr );
+typedef void (*module_state_load_fn)( const libspectrum_byte **ptr );
 
 typedef struct module_info_t
 {
@@ -43,6 +46,11 @@ typedef struct module_info_t
   module_snapshot_from_fn snapshot_from;
   module_snapshot_to_fn snapshot_to;
 
+  /* Native savestate support (see state.h); optional */
+  module_state_size_fn state_size;
+  module_state_save_fn state_save;
+  module_state_load_fn state_load;
+
 } module_info_t;
 
 int module_register( module_info_t *module );
@@ -53,5 +61,8 @@ void module_romcs( void );
 void module_snapshot_enabled( libspectrum_snap *snap );
 void module_snapshot_from( libspectrum_snap *snap );
 void module_snapshot_to( libspectrum_snap *snap );
+size_t module_state_size( void );
+void module_state_save( libspectrum_byte **ptr );
+void module_state_load( const libspectrum_byte **ptr );
 
 #endif			/* #ifndef FUSE_MODULE_H */
@@ -64,6 +64,44 @@ typedef struct periph_port_private_t {
 /* The list of currently active ports */
 static GSList *ports = NULL;
 
+/*
+ * The port decode table
+ */
+
+/* Rather than checking every active port response on each IN and OUT,
+   work out once which responses match each of the 65536 ports. Ports
+   matching the same set of responses share a decode entry, which holds
+   the responses to call on a read and on a write as lists of indexes
+   into `decode_ports' terminated by DECODE_END, in the same order as
+   `ports'. The table is rebuilt the next time a port is accessed after
+   the set of active ports changes */
+
+#define DECODE_MAX_PORTS 64
+#define DECODE_END 0xff
+
+typedef struct decode_entry_t {
+  /* Which responses match; only used while building the table */
+  libspectrum_qword match;
+  /* Where the lists of responses start in `decode_lists' */
+  size_t read, write;
+} decode_entry_t;
+
+static int decode_valid = 0;
+
+/* Zero if there are too many active responses to use the table, in which
+   case we just walk the list as before */
+static int decode_usable = 0;
+
+static const periph_port_t *decode_ports[ DECODE_MAX_PORTS ];
+
+static libspectrum_word decode_table[ 0x10000 ];
+
+static decode_entry_t *decode_entries = NULL;
+static size_t decode_entry_count = 0, decode_entry_size = 0;
+
+static libspectrum_byte *decode_lists = NULL;
+static size_t decode_lists_length = 0, decode_lists_size = 0;
+
 /* The strings used for debugger events */
 static const char *page_event_string = "page",
   *unpage_event_string = "unpage";
@@ -80,6 +118,7 @@ port_register( periph_type type, const periph_port_t *port )
   private->port = *port;
 
   ports = g_slist_append( ports, private );
+  decode_valid = 0;
 }
 
 /* Register a peripheral with the system */
@@ -134,6 +173,7 @@ periph_activate_type( periph_type type, int active )
     GSList *found;
     while( ( found = g_slist_find_custom( ports, GINT_TO_POINTER( type ), find_by_type ) ) != NULL )
       ports = g_slist_remove( ports, found->data );
+    decode_valid = 0;
   }
 
   return 1;
@@ -222,6 +262,7 @@ periph_clear( void )
   g_slist_foreach( ports, free_peripheral, NULL );
   g_slist_free( ports );
   ports = NULL;
+  decode_valid = 0;
   set_types_inactive();
 }
 
@@ -232,11 +273,104 @@ periph_end( void )
   g_slist_foreach( ports, free_peripheral, NULL );
   g_slist_free( ports );
   ports = NULL;
+  decode_valid = 0;
+
+  libspectrum_free( decode_entries );
+  decode_entries = NULL;
+  decode_entry_count = decode_entry_size = 0;
+
+  libspectrum_free( decode_lists );
+  decode_lists = NULL;
+  decode_lists_length = decode_lists_size = 0;
 
   g_hash_table_destroy( peripherals );
   peripherals = NULL;
 }
 
+/* Append one list of matching responses to `decode_lists' */
+static size_t
+decode_add_list( libspectrum_qword match, size_t count, int write )
+{
+  size_t start = decode_lists_length, i;
+
+  if( decode_lists_size < decode_lists_length + count + 1 ) {
+    decode_lists_size = 2 * ( decode_lists_length + count + 1 );
+    decode_lists = libspectrum_realloc( decode_lists, decode_lists_size );
+  }
+
+  for( i = 0; i < count; i++ ) {
+    if( !( match & ( (libspectrum_qword)1 << i ) ) ) continue;
+    if( write ? !decode_ports[i]->write : !decode_ports[i]->read ) continue;
+    decode_lists[ decode_lists_length++ ] = i;
+  }
+
+  decode_lists[ decode_lists_length++ ] = DECODE_END;
+
+  return start;
+}
+
+/* Find, or make, the decode entry for one set of matching responses */
+static libspectrum_word
+decode_find_entry( libspectrum_qword match, size_t count )
+{
+  decode_entry_t *entry;
+  size_t i;
+
+  for( i = 0; i < decode_entry_count; i++ )
+    if( decode_entries[i].match == match ) return i;
+
+  if( decode_entry_count == decode_entry_size ) {
+    decode_entry_size = decode_entry_size ? 2 * decode_entry_size : 16;
+    decode_entries =
+      libspectrum_realloc( decode_entries,
+                           decode_entry_size * sizeof( *decode_entries ) );
+  }
+
+  entry = &decode_entries[ decode_entry_count ];
+  entry->match = match;
+  entry->read = decode_add_list( match, count, 0 );
+  entry->write = decode_add_list( match, count, 1 );
+
+  return decode_entry_count++;
+}
+
+static void
+decode_build( void )
+{
+  GSList *list;
+  size_t count = 0, i;
+  libspectrum_dword port;
+  libspectrum_qword match, last_match = 0;
+  libspectrum_word last_entry = 0;
+
+  decode_valid = 1;
+  decode_entry_count = 0;
+  decode_lists_length = 0;
+
+  for( list = ports; list; list = list->next ) {
+    if( count == DECODE_MAX_PORTS ) { decode_usable = 0; return; }
+    decode_ports[ count++ ] = &( (periph_port_private_t*)list->data )->port;
+  }
+
+  decode_usable = 1;
+
+  for( port = 0; port < 0x10000; port++ ) {
+
+    match = 0;
+    for( i = 0; i < count; i++ )
+      if( ( port & decode_ports[i]->mask ) == decode_ports[i]->value )
+        match |= (libspectrum_qword)1 << i;
+
+    /* Neighbouring ports usually decode the same way */
+    if( port == 0 || match != last_match ) {
+      last_entry = decode_find_entry( match, count );
+      last_match = match;
+    }
+
+    decode_table[ port ] = last_entry;
+  }
+}
+
 /*
  * The actual routines to read and write a port
  */
@@ -322,7 +456,18 @@ readport_internal( libspectrum_word port )
   callback_info.attached = 0;
   callback_info.value = 0xff;
 
-  g_slist_foreach( ports, read_peripheral, &callback_info );
+  if( !decode_valid ) decode_build();
+
+  if( decode_usable ) {
+    const libspectrum_byte *index =
+      decode_lists + decode_entries[ decode_table[ port ] ].read;
+
+    for( ; *index != DECODE_END; index++ )
+      callback_info.value &=
+        decode_ports[ *index ]->read( port, &( callback_info.attached ) );
+  } else {
+    g_slist_foreach( ports, read_peripheral, &callback_info );
+  }
 
   if( !callback_info.attached )
     callback_info.value = machine_current->unattached_port();
@@ -366,6 +511,17 @@ writeport_internal( libspectrum_word port, libspectrum_byte b )
   if( debugger_mode != DEBUGGER_MODE_INACTIVE )
     debugger_check( DEBUGGER_BREAKPOINT_TYPE_PORT_WRITE, port );
 
+  if( !decode_valid ) decode_build();
+
+  if( decode_usable ) {
+    const libspectrum_byte *index =
+      decode_lists + decode_entries[ decode_table[ port ] ].write;
+
+    for( ; *index != DECODE_END; index++ )
+      decode_ports[ *index ]->write( port, b );
+    return;
+  }
+
   callback_info.port = port;
   callback_info.value = b;
   
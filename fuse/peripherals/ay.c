@@ -34,6 +34,7 @@
 #include "printer.h"
 #include "psg.h"
 #include "sound.h"
+#include "state.h"
 
 /* Unused bits in the AY registers are silently zeroed out; these masks
    accomplish this */
@@ -47,6 +48,9 @@ static const libspectrum_byte mask[ AY_REGISTERS ] = {
 static void ay_reset( int hard_reset );
 static void ay_from_snapshot( libspectrum_snap *snap );
 static void ay_to_snapshot( libspectrum_snap *snap );
+static size_t ay_state_size( void );
+static void ay_state_save( libspectrum_byte **ptr );
+static void ay_state_load( const libspectrum_byte **ptr );
 
 static module_info_t ay_module_info = {
 
@@ -55,6 +59,9 @@ static module_info_t ay_module_info = {
   NULL,
   ay_from_snapshot,
   ay_to_snapshot,
+  ay_state_size,
+  ay_state_save,
+  ay_state_load,
 
 };
 
@@ -222,3 +229,33 @@ ay_to_snapshot( libspectrum_snap *snap )
     libspectrum_snap_set_ay_registers( snap, i,
 				       machine_current->ay.registers[i] );
 }
+
+static size_t
+ay_state_size( void )
+{
+  return 1 + AY_REGISTERS;
+}
+
+static void
+ay_state_save( libspectrum_byte **ptr )
+{
+  state_write_byte( ptr, machine_current->ay.current_register );
+  state_write_block( ptr, machine_current->ay.registers, AY_REGISTERS );
+}
+
+static void
+ay_state_load( const libspectrum_byte **ptr )
+{
+  machine_current->ay.current_register = state_read_byte( ptr );
+  state_read_block( ptr, machine_current->ay.registers, AY_REGISTERS );
+
+  ay_sound_refresh();
+}
+
+void
+ay_sound_refresh( void )
+{
+  if( !sound_ay_present() ) return;
+
+  sound_ay_refresh( machine_current->ay.registers );
+}
@@ -44,4 +44,8 @@ void ay_dataport_write( libspectrum_word port, libspectrum_byte b );
 
 void ay_state_from_snapshot( libspectrum_snap *snap );
 
+/* Pass the registers on to the sound code again, for when it has missed
+   some writes; ones it already has aren't written again */
+void ay_sound_refresh( void );
+
 #endif			/* #ifndef FUSE_AY_H */
@@ -180,6 +180,7 @@ dck_reset( void )
             } else {
               memset( page->page, 0, MEMORY_PAGE_SIZE );
             }
+            memory_ram_set_dirty( page->page_num, page->offset );
           }
         } else {
           data = memory_pool_allocate( 0x2000 );
@@ -47,6 +47,7 @@
 #include "machine.h"
 #include "module.h"
 #include "settings.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "unittests/unittests.h"
 #include "utils.h"
@@ -101,6 +102,9 @@ static void beta_memory_map( void );
 static void beta_enabled_snapshot( libspectrum_snap *snap );
 static void beta_from_snapshot( libspectrum_snap *snap );
 static void beta_to_snapshot( libspectrum_snap *snap );
+static size_t beta_state_size( void );
+static void beta_state_save( libspectrum_byte **ptr );
+static void beta_state_load( const libspectrum_byte **ptr );
 static void beta_event_index( libspectrum_dword last_tstates, int type,
 			      void *user_data );
 
@@ -111,6 +115,9 @@ static module_info_t beta_module_info = {
   beta_enabled_snapshot,
   beta_from_snapshot,
   beta_to_snapshot,
+  beta_state_size,
+  beta_state_save,
+  beta_state_load,
 
 };
 
@@ -825,3 +832,57 @@ beta_unittest( void )
   return r;
 }
 
+
+static size_t
+beta_state_size( void )
+{
+  return 8;
+}
+
+static void
+beta_state_save( libspectrum_byte **ptr )
+{
+  wd_fdc *f = beta_fdc;
+
+  state_write_byte( ptr, beta_active );
+  state_write_byte( ptr, beta_index_pulse );
+  state_write_byte( ptr, f->direction );
+  state_write_byte( ptr, f->status_register );
+  state_write_byte( ptr, f->track_register );
+  state_write_byte( ptr, f->sector_register );
+  state_write_byte( ptr, f->data_register );
+  state_write_byte( ptr, beta_system_register );
+}
+
+static void
+beta_state_load( const libspectrum_byte **ptr )
+{
+  wd_fdc *f = beta_fdc;
+  int active = state_read_byte( ptr );
+  int index_pulse = state_read_byte( ptr );
+  fdd_dir_t direction = state_read_byte( ptr );
+  libspectrum_byte status = state_read_byte( ptr );
+  libspectrum_byte track = state_read_byte( ptr );
+  libspectrum_byte sector = state_read_byte( ptr );
+  libspectrum_byte data = state_read_byte( ptr );
+  libspectrum_byte system = state_read_byte( ptr );
+
+  if( !periph_is_active( PERIPH_TYPE_BETA128 ) ) return;
+
+  /* The memory map is rebuilt once all modules are restored */
+  beta_active = active;
+  machine_current->ram.romcs = active;
+  beta_index_pulse = index_pulse;
+
+  f->direction = direction;
+  f->status_register = status;
+  f->track_register = track;
+  f->sector_register = sector;
+  f->data_register = data;
+
+  if( beta_active ) {
+    beta_sp_write( 0x00ff, system );
+  } else {
+    beta_system_register = system;
+  }
+}
@@ -34,6 +34,7 @@
 
 #include "compat.h"
 #include "machine.h"
+#include "memory.h"
 #include "module.h"
 #include "opus.h"
 #include "peripherals/printer.h"
@@ -110,6 +111,7 @@ void
 opus_page( void )
 {
   opus_active = 1;
+  memory_hooks |= MEMORY_HOOK_OPUS;
   machine_current->ram.romcs = 1;
   machine_current->memory_map();
 }
@@ -118,6 +120,7 @@ void
 opus_unpage( void )
 {
   opus_active = 0;
+  memory_hooks &= ~MEMORY_HOOK_OPUS;
   machine_current->ram.romcs = 0;
   machine_current->memory_map();
 }
@@ -182,6 +185,7 @@ opus_reset( int hard_reset )
   const fdd_params_t *dt;
 
   opus_active = 0;
+  memory_hooks &= ~MEMORY_HOOK_OPUS;
   opus_available = 0;
 
   event_remove_type( index_event );
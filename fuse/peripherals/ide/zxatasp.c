@@ -512,8 +512,10 @@ zxatasp_memory_map( void )
     for( i = 0; i < MEMORY_PAGES_IN_16K; i++ )
       memory_map_read[i] = zxatasp_memory_map_romcs[i];
 
-  for( i = 0; i < MEMORY_PAGES_IN_16K; i++ )
+  for( i = 0; i < MEMORY_PAGES_IN_16K; i++ ) {
     memory_map_write[i] = zxatasp_memory_map_romcs[i];
+    memory_map_hot_update( i );
+  }
 }
 
 static void
@@ -285,8 +285,10 @@ zxcf_memory_map( void )
       memory_map_read[i] = zxcf_memory_map_romcs[i];
   }
 
-  for( i = 0; i < MEMORY_PAGES_IN_16K; i++ )
+  for( i = 0; i < MEMORY_PAGES_IN_16K; i++ ) {
     memory_map_write[i] = zxcf_memory_map_romcs[i];
+    memory_map_hot_update( i );
+  }
 }
 
 static void
@@ -40,6 +40,7 @@
 #include "periph.h"
 #include "scld.h"
 #include "spectrum.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "z80/z80.h"
 
@@ -54,6 +55,9 @@ memory_page timex_dock[MEMORY_PAGES_IN_64K];
 static void scld_reset( int hard_reset );
 static void scld_from_snapshot( libspectrum_snap *snap );
 static void scld_to_snapshot( libspectrum_snap *snap );
+static size_t scld_state_size( void );
+static void scld_state_save( libspectrum_byte **ptr );
+static void scld_state_load( const libspectrum_byte **ptr );
 
 static module_info_t scld_module_info = {
 
@@ -62,6 +66,9 @@ static module_info_t scld_module_info = {
   NULL,
   scld_from_snapshot,
   scld_to_snapshot,
+  scld_state_size,
+  scld_state_save,
+  scld_state_load,
 
 };
 
@@ -340,3 +347,41 @@ scld_home_map_16k( libspectrum_word address, memory_page source[],
     timex_home[ page ] = &source[ page_num * MEMORY_PAGES_IN_16K + i ];
   }
 }
+
+static size_t
+scld_state_size( void )
+{
+  return 2;
+}
+
+static void
+scld_state_save( libspectrum_byte **ptr )
+{
+  state_write_byte( ptr, scld_last_hsr );
+  state_write_byte( ptr, scld_last_dec.byte );
+}
+
+static void
+scld_state_load( const libspectrum_byte **ptr )
+{
+  libspectrum_byte ink, paper;
+  scld old_dec = scld_last_dec;
+
+  /* Don't go via scld_dec_write() as that could accept an interrupt; the
+     memory map is rebuilt once all modules are restored */
+  scld_last_hsr = state_read_byte( ptr );
+  scld_last_dec.byte = state_read_byte( ptr );
+
+  /* The screen is only redrawn where RAM changes, so a different mode
+     must redraw the lot, as in scld_dec_write() */
+  if( scld_last_dec.mask.scrnmode != old_dec.mask.scrnmode ||
+      scld_last_dec.name.hires != old_dec.name.hires ||
+      ( scld_last_dec.name.hires &&
+           ( scld_last_dec.mask.hirescol != old_dec.mask.hirescol ) ) )
+    display_refresh_main_screen();
+
+  if( machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_TIMEX_VIDEO ) {
+    display_parse_attr( hires_get_attr(), &ink, &paper );
+    display_set_hires_border( paper );
+  }
+}
@@ -96,6 +96,7 @@ spectranet_page( int via_io )
     return;
 
   spectranet_paged = 1;
+  memory_hooks |= MEMORY_HOOK_SPECTRANET;
   spectranet_paged_via_io = via_io;
   machine_current->ram.romcs = 1;
   machine_current->memory_map();
@@ -116,6 +117,7 @@ spectranet_unpage( void )
     return;
 
   spectranet_paged = 0;
+  memory_hooks &= ~MEMORY_HOOK_SPECTRANET;
   spectranet_paged_via_io = 0;
   machine_current->ram.romcs = 0;
   machine_current->memory_map();
@@ -170,11 +172,17 @@ spectranet_reset( int hard_reset )
   if( !periph_is_active( PERIPH_TYPE_SPECTRANET ) ) {
     spectranet_available = 0;
     spectranet_paged = 0;
+    memory_hooks &= ~MEMORY_HOOK_SPECTRANET;
     return;
   }
 
   spectranet_available = 1;
   spectranet_paged = !settings_current.spectranet_disable;
+  if( spectranet_paged ) {
+    memory_hooks |= MEMORY_HOOK_SPECTRANET;
+  } else {
+    memory_hooks &= ~MEMORY_HOOK_SPECTRANET;
+  }
 
   if( hard_reset )
     spectranet_hard_reset();
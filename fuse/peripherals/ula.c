@@ -28,6 +28,7 @@
 #include <libspectrum.h>
 
 #include "compat.h"
+#include "event.h"
 #include "keyboard.h"
 #include "loader.h"
 #include "machine.h"
@@ -36,14 +37,22 @@
 #include "settings.h"
 #include "sound.h"
 #include "spectrum.h"
+#include "state.h"
 #include "tape.h"
 #include "ula.h"
+#include "z80/z80.h"
 
 static libspectrum_byte last_byte;
 
 libspectrum_byte ula_contention[ ULA_CONTENTION_SIZE ];
 libspectrum_byte ula_contention_no_mreq[ ULA_CONTENTION_SIZE ];
 
+libspectrum_dword ula_contention_start, ula_contention_end;
+
+/* Event marking where the Z80 core can change to or from its copy without
+   contention */
+static int ula_contention_event;
+
 /* What to return if no other input pressed; depends on the last byte
    output to the ULA; see CSS FAQ | Technical Information | Port #FE
    for full details */
@@ -51,6 +60,9 @@ libspectrum_byte ula_default_value;
 
 static void ula_from_snapshot( libspectrum_snap *snap );
 static void ula_to_snapshot( libspectrum_snap *snap );
+static size_t ula_state_size( void );
+static void ula_state_save( libspectrum_byte **ptr );
+static void ula_state_load( const libspectrum_byte **ptr );
 static libspectrum_byte ula_read( libspectrum_word port, int *attached );
 static void ula_write( libspectrum_word port, libspectrum_byte b );
 
@@ -61,6 +73,9 @@ static module_info_t ula_module_info = {
   NULL,
   ula_from_snapshot,
   ula_to_snapshot,
+  ula_state_size,
+  ula_state_save,
+  ula_state_load,
 
 };
 
@@ -97,6 +112,8 @@ ula_init( void )
   periph_register( PERIPH_TYPE_ULA_FULL_DECODE, &ula_periph_full_decode );
 
   ula_default_value = 0xff;
+
+  ula_contention_event = event_register( NULL, "Edge of contention" );
 }
 
 static libspectrum_byte
@@ -175,10 +192,44 @@ ula_to_snapshot( libspectrum_snap *snap )
   libspectrum_snap_set_issue2( snap, settings_current.issue2 );
 }  
 
+/* Find the tstates the contention tables have delays for; called whenever
+   the tables change. The whole of each table is looked at, as an
+   instruction can run on past the end of the frame */
+void
+ula_contention_update( void )
+{
+  libspectrum_dword i;
+
+  ula_contention_start = ula_contention_end = 0;
+
+  for( i = 0; i < ULA_CONTENTION_SIZE; i++ ) {
+    if( ula_contention[ i ] || ula_contention_no_mreq[ i ] ) {
+      if( !ula_contention_end ) ula_contention_start = i;
+      ula_contention_end = i + 1;
+    }
+  }
+
+  event_remove_type( ula_contention_event );
+  ula_contention_events_add();
+}
+
+/* Stop the Z80 core just before the window above and just after it each
+   frame, so it can change copies there */
+void
+ula_contention_events_add( void )
+{
+  if( !z80_uncontended || !ula_contention_end ) return;
+
+  if( ula_contention_start >= Z80_UNCONTENDED_LEAD )
+    event_add( ula_contention_start - Z80_UNCONTENDED_LEAD,
+               ula_contention_event );
+  event_add( ula_contention_end, ula_contention_event );
+}
+
 void
 ula_contend_port_early( libspectrum_word port )
 {
-  if( memory_map_read[ port >> MEMORY_PAGE_SIZE_LOGARITHM ].contended )
+  if( memory_hot_read_contended( port ) )
     tstates += ula_contention_no_mreq[ tstates ];
    
   tstates++;
@@ -193,7 +244,7 @@ ula_contend_port_late( libspectrum_word port )
 
   } else {
 
-    if( memory_map_read[ port >> MEMORY_PAGE_SIZE_LOGARITHM ].contended ) {
+    if( memory_hot_read_contended( port ) ) {
       tstates += ula_contention_no_mreq[ tstates ]; tstates++;
       tstates += ula_contention_no_mreq[ tstates ]; tstates++;
       tstates += ula_contention_no_mreq[ tstates ];
@@ -203,3 +254,25 @@ ula_contend_port_late( libspectrum_word port )
 
   }
 }
+
+static size_t
+ula_state_size( void )
+{
+  return 1 + 1;
+}
+
+static void
+ula_state_save( libspectrum_byte **ptr )
+{
+  state_write_byte( ptr, last_byte );
+  state_write_byte( ptr, settings_current.issue2 );
+}
+
+static void
+ula_state_load( const libspectrum_byte **ptr )
+{
+  libspectrum_byte b = state_read_byte( ptr );
+
+  settings_current.issue2 = state_read_byte( ptr );
+  ula_write( 0x00fe, b );
+}
@@ -34,6 +34,13 @@ extern libspectrum_byte ula_contention[ ULA_CONTENTION_SIZE ];
 /* And how much when it is inactive */
 extern libspectrum_byte ula_contention_no_mreq[ ULA_CONTENTION_SIZE ];
 
+/* The tstates from ula_contention_start up to ula_contention_end are the
+   only ones either of the tables above has a delay for */
+extern libspectrum_dword ula_contention_start, ula_contention_end;
+
+void ula_contention_update( void );
+void ula_contention_events_add( void );
+
 void ula_init( void );
 
 libspectrum_byte ula_last_byte( void );
@@ -437,6 +437,7 @@ pokemem_poke_activate( gpointer data, gpointer user_data )
     address &= 0x3fff;
     poke->restore = RAM[ bank ][ address ];
     RAM[ bank ][ address ] = value;
+    memory_ram_set_dirty( bank, address );
   }
 }
 
@@ -465,6 +466,7 @@ pokemem_poke_deactivate( gpointer data, gpointer user_data GCC_UNUSED )
     writebyte_internal( address, value );
   } else {
     RAM[ bank ][ address & 0x3fff ] = value;
+    memory_ram_set_dirty( bank, address );
   }
 
 }
@@ -0,0 +1,416 @@
+/* rewind.c: Compressed history of machine states for rewinding
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <libspectrum.h>
+
+#include "display.h"
+#include "machine.h"
+#include "memory.h"
+#include "rewind.h"
+#include "settings.h"
+#include "state.h"
+
+/*
+ * `shadow' and `machine' hold the newest capture in full: RAM as it was
+ * then, and the state_machine_write() output. Pages written to since are
+ * those with MEMORY_RAM_DIRTY_REWIND set.
+ *
+ * The history itself is a ring of `history_size' bytes holding one entry
+ * per capture, oldest first:
+ *
+ *   dword  length of the whole entry
+ *   word   number of pages
+ *   dword  length of the machine delta, then the delta
+ *   for each page:
+ *     word   page number
+ *     word   length of the delta, then the delta
+ *   dword  length of the whole entry again, so the newest entry can be
+ *          found from the end
+ *
+ * Each delta is the capture XORed with the one before it, so applying
+ * the newest entry's deltas to `shadow' and `machine' turns them into the
+ * capture before. The oldest entry's deltas lead back to a capture which
+ * has been dropped, so are never used.
+ */
+
+static libspectrum_byte *history = NULL;
+static size_t history_size = 0, history_start = 0, history_used = 0;
+static size_t count = 0;
+
+static libspectrum_byte *shadow = NULL;
+static libspectrum_byte *machine = NULL, *machine_new = NULL;
+static size_t machine_length;
+
+/* Where entries are put together and taken apart */
+static libspectrum_byte *scratch = NULL;
+
+/* What the history was captured from */
+static const fuse_machine_info *rewind_machine = NULL;
+static int rewind_late_timings;
+
+#define ENTRY_HEADER_LENGTH ( 4 + 2 + 4 )
+#define ENTRY_TRAILER_LENGTH 4
+
+/* The longest delta of `length' bytes could be */
+#define DELTA_MAX_LENGTH( length ) ( (length) + (length) / 128 + 1 )
+
+static libspectrum_byte*
+shadow_page( size_t page )
+{
+  return shadow + page * MEMORY_PAGE_SIZE;
+}
+
+/* Deltas are runs introduced by a control byte: 0x00 to 0x7f is followed
+   by that many plus one bytes to XOR in, while anything with bit 7 set
+   skips bytes which haven't changed: the bottom six bits plus one of
+   them, with bit 6 meaning another byte follows with bits 6 to 13 of the
+   count less one */
+
+static size_t
+delta_encode( libspectrum_byte *dest, const libspectrum_byte *a,
+              const libspectrum_byte *b, size_t length )
+{
+  libspectrum_byte *ptr = dest;
+  size_t i = 0, run;
+
+  while( i < length ) {
+
+    for( run = 0; i + run < length && run < 0x4000 && a[ i + run ] == b[ i + run ];
+         run++ )
+      ;
+
+    if( run ) {
+      run--;
+      if( run < 0x40 ) {
+        *ptr++ = 0x80 | run;
+      } else {
+        *ptr++ = 0xc0 | ( run & 0x3f );
+        *ptr++ = run >> 6;
+      }
+      i += run + 1;
+      continue;
+    }
+
+    /* Carry on until at least two bytes in a row are unchanged, as a
+       single one costs no more to include than to skip */
+    for( run = 0; i + run < length && run < 0x80; run++ ) {
+      if( a[ i + run ] == b[ i + run ] &&
+          ( i + run + 1 == length || a[ i + run + 1 ] == b[ i + run + 1 ] ) )
+        break;
+    }
+
+    *ptr++ = run - 1;
+    for( ; run; run--, i++ ) *ptr++ = a[i] ^ b[i];
+  }
+
+  return ptr - dest;
+}
+
+static void
+delta_apply( libspectrum_byte *dest, const libspectrum_byte *delta,
+             size_t length )
+{
+  const libspectrum_byte *end = delta + length;
+  size_t run;
+
+  while( delta < end ) {
+    libspectrum_byte control = *delta++;
+
+    if( control & 0x80 ) {
+      run = control & 0x3f;
+      if( control & 0x40 ) run |= *delta++ << 6;
+      dest += run + 1;
+    } else {
+      for( run = control + 1; run; run-- ) *dest++ ^= *delta++;
+    }
+  }
+}
+
+static void
+ring_write( size_t offset, const libspectrum_byte *data, size_t length )
+{
+  size_t first;
+
+  offset %= history_size;
+  first = history_size - offset;
+
+  if( length <= first ) {
+    memcpy( history + offset, data, length );
+  } else {
+    memcpy( history + offset, data, first );
+    memcpy( history, data + first, length - first );
+  }
+}
+
+static void
+ring_read( size_t offset, libspectrum_byte *data, size_t length )
+{
+  size_t first;
+
+  offset %= history_size;
+  first = history_size - offset;
+
+  if( length <= first ) {
+    memcpy( data, history + offset, length );
+  } else {
+    memcpy( data, history + offset, first );
+    memcpy( data + first, history, length - first );
+  }
+}
+
+static libspectrum_dword
+ring_read_dword( size_t offset )
+{
+  libspectrum_byte buffer[4];
+  const libspectrum_byte *ptr = buffer;
+
+  ring_read( offset, buffer, 4 );
+  return state_read_dword( &ptr );
+}
+
+int
+rewind_init( size_t budget )
+{
+  rewind_end();
+
+  if( !budget ) return 0;
+
+  history = libspectrum_malloc( budget );
+  history_size = budget;
+
+  shadow = libspectrum_malloc( SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K *
+                               MEMORY_PAGE_SIZE );
+
+  return 0;
+}
+
+void
+rewind_end( void )
+{
+  libspectrum_free( history ); history = NULL;
+  history_size = 0;
+
+  libspectrum_free( shadow ); shadow = NULL;
+  libspectrum_free( machine ); machine = NULL;
+  libspectrum_free( machine_new ); machine_new = NULL;
+  libspectrum_free( scratch ); scratch = NULL;
+
+  rewind_clear();
+}
+
+void
+rewind_clear( void )
+{
+  history_start = history_used = count = 0;
+  rewind_machine = NULL;
+}
+
+size_t
+rewind_count( void )
+{
+  return count;
+}
+
+size_t
+rewind_memory_used( void )
+{
+  return history_used;
+}
+
+static int
+same_machine( void )
+{
+  return rewind_machine == machine_current &&
+         rewind_late_timings == settings_current.late_timings;
+}
+
+/* Start a new history from a complete copy of the machine */
+static void
+start( size_t pages )
+{
+  size_t i;
+
+  for( i = 0; i < pages; i++ ) {
+    memcpy( shadow_page( i ), memory_map_ram[i].page, MEMORY_PAGE_SIZE );
+    memory_ram_dirty[i] &= ~MEMORY_RAM_DIRTY_REWIND;
+  }
+
+  if( !same_machine() ) {
+    machine_length = state_machine_size();
+    machine = libspectrum_realloc( machine, machine_length );
+    machine_new = libspectrum_realloc( machine_new, machine_length );
+    scratch = libspectrum_realloc( scratch,
+      ENTRY_HEADER_LENGTH + DELTA_MAX_LENGTH( machine_length ) +
+      pages * ( 2 + 2 + DELTA_MAX_LENGTH( MEMORY_PAGE_SIZE ) ) +
+      ENTRY_TRAILER_LENGTH );
+
+    rewind_machine = machine_current;
+    rewind_late_timings = settings_current.late_timings;
+  }
+
+  memset( machine, 0, machine_length );
+  state_machine_write( machine );
+
+  history_start = history_used = count = 0;
+}
+
+/* Put the entry in `scratch' at the end of the history, making room
+   for it if need be */
+static int
+store( size_t length )
+{
+  if( length > history_size ) {
+    rewind_clear();
+    return 1;
+  }
+
+  while( history_size - history_used < length ) {
+    libspectrum_dword oldest = ring_read_dword( history_start );
+
+    history_start = ( history_start + oldest ) % history_size;
+    history_used -= oldest;
+    count--;
+  }
+
+  ring_write( history_start + history_used, scratch, length );
+  history_used += length;
+  count++;
+
+  return 0;
+}
+
+int
+rewind_capture( void )
+{
+  libspectrum_byte *ptr, *length_ptr;
+  libspectrum_word pages_written = 0;
+  size_t i, pages, length;
+
+  if( !history || !state_available() ) return 1;
+
+  pages = memory_state_ram_pages();
+
+  if( !count || !same_machine() ) {
+    /* The first entry has nothing to go back to */
+    start( pages );
+    ptr = scratch;
+    state_write_dword( &ptr, ENTRY_HEADER_LENGTH + ENTRY_TRAILER_LENGTH );
+    state_write_word( &ptr, 0 );
+    state_write_dword( &ptr, 0 );
+    state_write_dword( &ptr, ENTRY_HEADER_LENGTH + ENTRY_TRAILER_LENGTH );
+    return store( ptr - scratch );
+  }
+
+  ptr = scratch + 4 + 2;
+
+  memset( machine_new, 0, machine_length );
+  state_machine_write( machine_new );
+
+  length = delta_encode( ptr + 4, machine_new, machine, machine_length );
+  state_write_dword( &ptr, length );
+  ptr += length;
+  memcpy( machine, machine_new, machine_length );
+
+  for( i = 0; i < pages; i++ ) {
+    const libspectrum_byte *page = memory_map_ram[i].page;
+
+    if( !( memory_ram_dirty[i] & MEMORY_RAM_DIRTY_REWIND ) ) continue;
+    memory_ram_dirty[i] &= ~MEMORY_RAM_DIRTY_REWIND;
+
+    if( !memcmp( page, shadow_page( i ), MEMORY_PAGE_SIZE ) ) continue;
+
+    state_write_word( &ptr, i );
+    length_ptr = ptr; ptr += 2;
+    length = delta_encode( ptr, page, shadow_page( i ), MEMORY_PAGE_SIZE );
+    state_write_word( &length_ptr, length );
+    ptr += length;
+
+    memcpy( shadow_page( i ), page, MEMORY_PAGE_SIZE );
+    pages_written++;
+  }
+
+  length = ptr - scratch + ENTRY_TRAILER_LENGTH;
+  state_write_dword( &ptr, length );
+
+  ptr = scratch;
+  state_write_dword( &ptr, length );
+  state_write_word( &ptr, pages_written );
+
+  return store( length );
+}
+
+int
+rewind_step_back( void )
+{
+  const libspectrum_byte *ptr;
+  libspectrum_dword length;
+  size_t i, pages;
+  int error;
+
+  if( !count ) return 1;
+
+  if( !same_machine() ) {
+    rewind_clear();
+    return 1;
+  }
+
+  pages = memory_state_ram_pages();
+
+  /* Back to the newest capture... */
+  for( i = 0; i < pages; i++ ) {
+    if( !( memory_ram_dirty[i] & MEMORY_RAM_DIRTY_REWIND ) ) continue;
+
+    memcpy( memory_map_ram[i].page, shadow_page( i ), MEMORY_PAGE_SIZE );
+    memory_ram_dirty[i] = MEMORY_RAM_DIRTY_ALL & ~MEMORY_RAM_DIRTY_REWIND;
+  }
+
+  error = state_machine_read( machine, machine_length );
+  display_refresh_all();
+
+  /* ...and then make the one before that the newest. Where the two
+     differ, RAM no longer matches the shadow */
+  length = ring_read_dword( history_start + history_used -
+                            ENTRY_TRAILER_LENGTH );
+  ring_read( history_start + history_used - length, scratch, length );
+  history_used -= length;
+  count--;
+
+  ptr = scratch + 4;
+  pages = state_read_word( &ptr );
+
+  length = state_read_dword( &ptr );
+  delta_apply( machine, ptr, length );
+  ptr += length;
+
+  for( i = 0; i < pages; i++ ) {
+    libspectrum_word page = state_read_word( &ptr );
+
+    length = state_read_word( &ptr );
+    delta_apply( shadow_page( page ), ptr, length );
+    ptr += length;
+
+    memory_ram_dirty[ page ] |= MEMORY_RAM_DIRTY_REWIND;
+  }
+
+  return error;
+}
@@ -0,0 +1,54 @@
+/* rewind.h: Compressed history of machine states for rewinding
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_REWIND_H
+#define FUSE_REWIND_H
+
+#include <stddef.h>
+
+/* Keeps as many past states as fit in a fixed amount of memory, each
+   stored as the difference from the one after it: the machine and every
+   4Kb RAM page written to in between are XORed against their newer
+   versions and the resulting runs of zeroes squeezed out. Stepping back
+   costs the same however long the history is. Uses the same machinery
+   as the native savestates, so nothing is captured while
+   state_available() says no */
+
+/* Keep up to `budget' bytes of history; 0 turns the history off */
+int rewind_init( size_t budget );
+
+void rewind_end( void );
+
+/* Forget the history; done automatically if the machine changes */
+void rewind_clear( void );
+
+/* Add the machine as it is now to the history, dropping the oldest states
+   if they no longer fit. Returns non-zero if it couldn't be captured */
+int rewind_capture( void );
+
+/* Put the machine back as it was at the newest capture and remove that
+   from the history, so the next call goes back one further. Returns
+   non-zero if there is nothing left to go back to */
+int rewind_step_back( void );
+
+/* The number of captures in the history, and the bytes they take */
+size_t rewind_count( void );
+size_t rewind_memory_used( void );
+
+#endif			/* #ifndef FUSE_REWIND_H */
@@ -0,0 +1,265 @@
+/* rollback.c: Ring of recent machine states for run-ahead
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include <libspectrum.h>
+
+#include "machine.h"
+#include "memory.h"
+#include "rollback.h"
+#include "settings.h"
+#include "state.h"
+
+/*
+ * `shadow' holds RAM as it was in the newest state. Each older state
+ * keeps the machine less its RAM, plus an undo list: the contents, as
+ * they were when it was taken, of every page written to between it and
+ * the next state. Pages written to since the newest state are those with
+ * MEMORY_RAM_DIRTY_ROLLBACK set, so
+ *
+ *   saving copies just those pages into the shadow, moving what was there
+ *     onto the newest state's undo list
+ *   restoring copies them back from the shadow, then applies undo lists
+ *     from the newest state back to the one wanted
+ */
+
+typedef struct rollback_state_t {
+  libspectrum_byte *machine;	/* state_machine_write() output */
+
+  libspectrum_word *undo_pages;
+  libspectrum_byte *undo_data;
+  size_t undo_count, undo_allocated;
+} rollback_state_t;
+
+static rollback_state_t *states = NULL;
+static size_t states_allocated = 0;
+
+/* The states in use run from states[ oldest ] for `count' entries,
+   wrapping round */
+static size_t oldest = 0, count = 0;
+
+static libspectrum_byte *shadow = NULL;
+
+/* What the states were taken from */
+static const fuse_machine_info *rollback_machine = NULL;
+static int rollback_late_timings;
+static size_t machine_length;
+
+static rollback_state_t*
+state_at( size_t age )
+{
+  return &states[ ( oldest + count - 1 - age ) % states_allocated ];
+}
+
+static libspectrum_byte*
+shadow_page( size_t page )
+{
+  return shadow + page * MEMORY_PAGE_SIZE;
+}
+
+int
+rollback_init( size_t n )
+{
+  rollback_end();
+
+  if( !n ) return 1;
+
+  states = libspectrum_malloc( n * sizeof( *states ) );
+  memset( states, 0, n * sizeof( *states ) );
+  states_allocated = n;
+
+  shadow = libspectrum_malloc( SPECTRUM_RAM_PAGES * MEMORY_PAGES_IN_16K *
+                               MEMORY_PAGE_SIZE );
+
+  rollback_clear();
+
+  return 0;
+}
+
+void
+rollback_end( void )
+{
+  size_t i;
+
+  for( i = 0; i < states_allocated; i++ ) {
+    libspectrum_free( states[i].machine );
+    libspectrum_free( states[i].undo_pages );
+    libspectrum_free( states[i].undo_data );
+  }
+
+  libspectrum_free( states ); states = NULL;
+  states_allocated = 0;
+
+  libspectrum_free( shadow ); shadow = NULL;
+
+  rollback_clear();
+}
+
+void
+rollback_clear( void )
+{
+  oldest = count = 0;
+  rollback_machine = NULL;
+}
+
+size_t
+rollback_count( void )
+{
+  return count;
+}
+
+static int
+same_machine( void )
+{
+  return rollback_machine == machine_current &&
+         rollback_late_timings == settings_current.late_timings;
+}
+
+/* Start again from a complete copy of RAM */
+static void
+start( size_t pages )
+{
+  size_t i;
+
+  for( i = 0; i < pages; i++ ) {
+    memcpy( shadow_page( i ), memory_map_ram[i].page, MEMORY_PAGE_SIZE );
+    memory_ram_dirty[i] &= ~MEMORY_RAM_DIRTY_ROLLBACK;
+  }
+
+  if( !same_machine() ) {
+    machine_length = state_machine_size();
+    for( i = 0; i < states_allocated; i++ )
+      states[i].machine = libspectrum_realloc( states[i].machine,
+                                               machine_length );
+
+    rollback_machine = machine_current;
+    rollback_late_timings = settings_current.late_timings;
+  }
+
+  oldest = count = 0;
+}
+
+static void
+undo_add( rollback_state_t *state, size_t page )
+{
+  if( state->undo_count == state->undo_allocated ) {
+    state->undo_allocated = state->undo_allocated ?
+                            2 * state->undo_allocated : 16;
+    state->undo_pages =
+      libspectrum_realloc( state->undo_pages,
+                           state->undo_allocated *
+                           sizeof( *state->undo_pages ) );
+    state->undo_data =
+      libspectrum_realloc( state->undo_data,
+                           state->undo_allocated * MEMORY_PAGE_SIZE );
+  }
+
+  state->undo_pages[ state->undo_count ] = page;
+  memcpy( state->undo_data + state->undo_count * MEMORY_PAGE_SIZE,
+          shadow_page( page ), MEMORY_PAGE_SIZE );
+  state->undo_count++;
+}
+
+int
+rollback_save( void )
+{
+  rollback_state_t *state;
+  size_t i, pages;
+
+  if( !states || !state_available() ) return 1;
+
+  pages = memory_state_ram_pages();
+
+  if( !count || !same_machine() ) {
+    start( pages );
+  } else {
+    state = state_at( 0 );
+
+    for( i = 0; i < pages; i++ ) {
+      if( !( memory_ram_dirty[i] & MEMORY_RAM_DIRTY_ROLLBACK ) ) continue;
+
+      /* With only one state, it is about to be dropped anyway */
+      if( states_allocated > 1 ) undo_add( state, i );
+
+      memcpy( shadow_page( i ), memory_map_ram[i].page, MEMORY_PAGE_SIZE );
+      memory_ram_dirty[i] &= ~MEMORY_RAM_DIRTY_ROLLBACK;
+    }
+  }
+
+  if( count == states_allocated ) {
+    oldest = ( oldest + 1 ) % states_allocated;
+    count--;
+  }
+
+  count++;
+  state = state_at( 0 );
+  state->undo_count = 0;
+  state_machine_write( state->machine );
+
+  return 0;
+}
+
+static void
+restore_page( size_t page, const libspectrum_byte *data )
+{
+  memory_display_dirty_ram( page, data );
+  memcpy( memory_map_ram[ page ].page, data, MEMORY_PAGE_SIZE );
+
+  /* Everyone else needs to know it has changed, but it is now as it was
+     in the newest state */
+  memory_ram_dirty[ page ] = MEMORY_RAM_DIRTY_ALL & ~MEMORY_RAM_DIRTY_ROLLBACK;
+}
+
+int
+rollback_restore( size_t age )
+{
+  rollback_state_t *state;
+  size_t i, pages;
+
+  if( age >= count || !same_machine() ) return 1;
+
+  pages = memory_state_ram_pages();
+
+  /* Back to the newest state first... */
+  for( i = 0; i < pages; i++ )
+    if( memory_ram_dirty[i] & MEMORY_RAM_DIRTY_ROLLBACK )
+      restore_page( i, shadow_page( i ) );
+
+  /* ...and from there through the older ones */
+  while( age-- ) {
+    count--;
+    state = state_at( 0 );
+
+    for( i = 0; i < state->undo_count; i++ ) {
+      libspectrum_word page = state->undo_pages[i];
+      const libspectrum_byte *data =
+        state->undo_data + i * MEMORY_PAGE_SIZE;
+
+      restore_page( page, data );
+      memcpy( shadow_page( page ), data, MEMORY_PAGE_SIZE );
+    }
+
+    state->undo_count = 0;
+  }
+
+  return state_machine_read( state_at( 0 )->machine, machine_length );
+}
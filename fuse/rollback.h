@@ -0,0 +1,51 @@
+/* rollback.h: Ring of recent machine states for run-ahead
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_ROLLBACK_H
+#define FUSE_ROLLBACK_H
+
+#include <stddef.h>
+
+/* Keeps the last few machine states in memory so that the frontend can
+   run frames speculatively and then put things back as they were. Only
+   the RAM pages written to between one state and the next are copied,
+   so saving and restoring cost little more than the machine's registers
+   and peripherals. Uses the same machinery as the native savestates, so
+   is only usable while state_available() says so */
+
+/* Keep up to `states' states, which must be at least one */
+int rollback_init( size_t states );
+
+void rollback_end( void );
+
+/* Forget every state; done automatically if the machine changes */
+void rollback_clear( void );
+
+/* Add the machine as it is now as the newest state, dropping the oldest
+   if the ring is full. Returns non-zero if the state couldn't be taken */
+int rollback_save( void );
+
+/* Put the machine back to the state `age' saves ago (0 being the newest)
+   and forget every state newer than that one */
+int rollback_restore( size_t age );
+
+/* The number of states which can currently be restored */
+size_t rollback_count( void );
+
+#endif			/* #ifndef FUSE_ROLLBACK_H */
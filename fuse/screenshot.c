@@ -33,6 +33,7 @@
 
 #include "display.h"
 #include "machine.h"
+#include "memory.h"
 #include "peripherals/scld.h"
 #include "screenshot.h"
 #include "settings.h"
@@ -386,6 +387,8 @@ screenshot_scr_read( const char *filename )
   error =  utils_read_file( filename, &screen );
   if( error ) return error;
 
+  memory_ram_set_16k_dirty( memory_current_screen );
+
   switch( screen.length ) {
   case STANDARD_SCR_SIZE:
     memcpy( &RAM[ memory_current_screen ][display_get_addr(0,0)],
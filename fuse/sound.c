@@ -30,6 +30,12 @@
 
 #include <config.h>
 
+#include <string.h>
+
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif				/* #ifdef HAVE_THREADS */
+
 #include "fuse.h"
 #include "machine.h"
 #include "movie.h"
@@ -39,11 +45,15 @@
 #include "tape.h"
 #include "ui/ui.h"
 #include "sound/blipbuffer.h"
+#ifdef HAVE_THREADS
+#include "sound/sfifo.h"
+#endif				/* #ifdef HAVE_THREADS */
 
 /* Do we have any of our sound devices available? */
 
 /* configuration */
 int sound_enabled = 0;		/* Are we currently using the sound card */
+int sound_suspended = 0;	/* Ignoring everything for now? */
 
 static int sound_enabled_ever = 0; /* whether sound has *ever* been in use; see
 				      sound_ay_write() and sound_ay_reset() */
@@ -57,11 +67,11 @@ int sound_stereo_ay = SOUND_STEREO_AY_NONE; /* local copy of settings_current.st
 #define AMPL_TAPE		( 2 * 256 )
 #define AMPL_AY_TONE		( 24 * 256 )	/* three of these */
 
-/* max. number of sub-frame AY port writes allowed;
- * given the number of port writes theoretically possible in a
- * 50th I think this should be plenty.
+/* the quickest an AY register can be written to is one OUT (n),A every
+ * 11 T-states, so a frame can't hold more writes than this, plus the
+ * full set of registers written at once on a reset or a state load.
  */
-#define AY_CHANGE_MAX		8000
+#define AY_CHANGE_FRAME_MAX( tstates ) ( (tstates) / 11 + 2 * 16 )
 
 int sound_framesiz;
 
@@ -70,9 +80,10 @@ static int sound_channels;
 static unsigned int ay_tone_levels[16];
 
 static unsigned int ay_tone_tick[3], ay_tone_high[3], ay_noise_tick;
-static unsigned int ay_tone_cycles, ay_env_cycles;
 static unsigned int ay_env_internal_tick, ay_env_tick;
 static unsigned int ay_tone_period[3], ay_noise_period, ay_env_period;
+static int ay_rng = 1, ay_noise_toggle = 0;
+static int ay_env_first = 1, ay_env_rev = 0, ay_env_counter = 15;
 
 /* Local copy of the AY registers */
 static libspectrum_byte sound_ay_registers[16];
@@ -83,8 +94,21 @@ struct ay_change_tag
   unsigned char reg, val;
 };
 
-static struct ay_change_tag ay_change[ AY_CHANGE_MAX ];
-static int ay_change_count;
+/* The writes not yet passed on to the sound generation, in a ring of
+   `ay_change_size' entries (always a power of two) starting from
+   `ay_change_start' */
+static struct ay_change_tag *ay_change = NULL;
+static size_t ay_change_size = 0, ay_change_start = 0, ay_change_count = 0;
+
+/* The value each register will have once every write in the ring has been
+   passed on */
+static libspectrum_byte ay_change_registers[16];
+
+/* Whether writes which can't change the sound are dropped */
+int sound_ay_coalesce = 1;
+
+/* Whether the sound is to be made on a thread of its own */
+int sound_threaded = 0;
 
 Blip_Buffer *left_buf = NULL;
 Blip_Buffer *right_buf = NULL;
@@ -106,6 +130,66 @@ struct speaker_type_tag
 static struct speaker_type_tag speaker_type[] =
   { { 200, -37.0 }, { 1000, -67.0 }, { 0, 0.0 } };
 
+static void ay_change_flush( void );
+static void ay_change_add( const struct ay_change_tag *change,
+                           libspectrum_dword frame_length );
+static long sound_make_frame( libspectrum_dword frame_length, int ay,
+                              blip_sample_t *dest );
+
+#ifdef HAVE_THREADS
+
+/*
+ * With sound_threaded set, the emulation only records what happens to the
+ * sound during each frame: every AY write, and every change to the beeper
+ * and SpecDrum levels. At the end of the frame the record is handed to the
+ * sound thread, which turns it into samples while the next frame is being
+ * emulated, and handed back a frame later for the samples to be passed on.
+ * So the sound is a frame late, but the same as it would otherwise be.
+ *
+ * There are two records, one being filled in while the sound thread works
+ * on the other. They go each way through an sfifo holding their addresses;
+ * the mutex and condition are only there so that each side can sleep until
+ * the other has given it something.
+ */
+
+struct sound_edge_tag
+{
+  libspectrum_dword tstates;
+  Blip_Synth *synth;
+  int val;
+};
+
+typedef struct sound_thread_frame_t {
+  libspectrum_dword frame_length;
+  int ay;			/* Is there an AY to be heard? */
+
+  struct ay_change_tag *ay_change;
+  size_t ay_change_count, ay_change_allocated;
+
+  struct sound_edge_tag *edge;
+  size_t edge_count, edge_allocated;
+
+  blip_sample_t *samples;
+  long count;
+} sound_thread_frame_t;
+
+static int sound_thread_running = 0;
+static pthread_t sound_thread;
+static pthread_mutex_t sound_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sound_thread_cond = PTHREAD_COND_INITIALIZER;
+
+/* Frames to be made, and frames which have been */
+static sfifo_t sound_thread_todo, sound_thread_done;
+
+static sound_thread_frame_t sound_thread_frames[2];
+
+/* The frame being recorded, and how many the sound thread has been given
+   but not yet handed back */
+static sound_thread_frame_t *sound_thread_current;
+static int sound_thread_queued;
+
+#endif				/* #ifdef HAVE_THREADS */
+
 static double
 sound_get_volume( int volume )
 {
@@ -170,11 +254,231 @@ sound_ay_init( void )
 
   ay_noise_tick = ay_noise_period = 0;
   ay_env_internal_tick = ay_env_tick = ay_env_period = 0;
-  ay_tone_cycles = ay_env_cycles = 0;
   for( f = 0; f < 3; f++ )
     ay_tone_tick[f] = ay_tone_high[f] = 0, ay_tone_period[f] = 1;
 
-  ay_change_count = 0;
+  ay_change_start = ay_change_count = 0;
+  memcpy( ay_change_registers, sound_ay_registers,
+          sizeof( ay_change_registers ) );
+}
+
+#ifdef HAVE_THREADS
+
+static void
+sound_thread_send( sfifo_t *fifo, sound_thread_frame_t *frame )
+{
+  sfifo_write( fifo, &frame, sizeof( frame ) );
+
+  pthread_mutex_lock( &sound_thread_mutex );
+  pthread_cond_broadcast( &sound_thread_cond );
+  pthread_mutex_unlock( &sound_thread_mutex );
+}
+
+/* Wait until `fifo' holds at least `count' frames */
+static void
+sound_thread_wait( sfifo_t *fifo, int count )
+{
+  pthread_mutex_lock( &sound_thread_mutex );
+  while( sfifo_used( fifo ) < count * (int)sizeof( sound_thread_frame_t* ) )
+    pthread_cond_wait( &sound_thread_cond, &sound_thread_mutex );
+  pthread_mutex_unlock( &sound_thread_mutex );
+}
+
+static sound_thread_frame_t*
+sound_thread_receive( sfifo_t *fifo )
+{
+  sound_thread_frame_t *frame;
+
+  sound_thread_wait( fifo, 1 );
+  sfifo_read( fifo, &frame, sizeof( frame ) );
+
+  return frame;
+}
+
+static void*
+sound_thread_main( void *arg GCC_UNUSED )
+{
+  sound_thread_frame_t *frame;
+  size_t i;
+
+  /* A NULL frame means stop */
+  while( ( frame = sound_thread_receive( &sound_thread_todo ) ) ) {
+
+    for( i = 0; i < frame->edge_count; i++ )
+      blip_synth_update( frame->edge[i].synth, frame->edge[i].tstates,
+                         frame->edge[i].val );
+
+    for( i = 0; i < frame->ay_change_count; i++ )
+      ay_change_add( &frame->ay_change[i], frame->frame_length );
+
+    frame->count = sound_make_frame( frame->frame_length, frame->ay,
+                                     frame->samples );
+
+    sound_thread_send( &sound_thread_done, frame );
+  }
+
+  return NULL;
+}
+
+static void
+sound_thread_start( void )
+{
+  size_t i;
+
+  if( sfifo_init( &sound_thread_todo, 4 * sizeof( sound_thread_frame_t* ) ) )
+    return;
+  if( sfifo_init( &sound_thread_done, 4 * sizeof( sound_thread_frame_t* ) ) ) {
+    sfifo_close( &sound_thread_todo );
+    return;
+  }
+
+  for( i = 0; i < 2; i++ ) {
+    sound_thread_frame_t *frame = &sound_thread_frames[i];
+
+    memset( frame, 0, sizeof( *frame ) );
+    frame->samples =
+      libspectrum_calloc( sound_framesiz * sound_channels,
+                          sizeof( blip_sample_t ) );
+  }
+
+  sound_thread_current = &sound_thread_frames[0];
+  sound_thread_queued = 0;
+
+  if( pthread_create( &sound_thread, NULL, sound_thread_main, NULL ) ) {
+    for( i = 0; i < 2; i++ )
+      libspectrum_free( sound_thread_frames[i].samples );
+    sfifo_close( &sound_thread_todo );
+    sfifo_close( &sound_thread_done );
+    return;
+  }
+
+  sound_thread_running = 1;
+}
+
+static void
+sound_thread_stop( void )
+{
+  sound_thread_frame_t *frame = sound_thread_current;
+  size_t i;
+
+  if( !sound_thread_running ) return;
+
+  /* The sound thread finishes every frame it has been given first */
+  sound_thread_send( &sound_thread_todo, NULL );
+  pthread_join( sound_thread, NULL );
+  sound_thread_running = 0;
+
+  /* and the writes since the last frame go where they would have done
+     without the thread */
+  for( i = 0; i < frame->ay_change_count; i++ )
+    ay_change_add( &frame->ay_change[i],
+                   machine_current->timings.tstates_per_frame );
+
+  for( i = 0; i < 2; i++ ) {
+    libspectrum_free( sound_thread_frames[i].ay_change );
+    libspectrum_free( sound_thread_frames[i].edge );
+    libspectrum_free( sound_thread_frames[i].samples );
+  }
+
+  sfifo_close( &sound_thread_todo );
+  sfifo_close( &sound_thread_done );
+}
+
+/* Wait for the sound thread to finish every frame it has been given, after
+   which the sound state belongs to this thread until the next frame */
+static void
+sound_thread_idle( void )
+{
+  if( sound_thread_running )
+    sound_thread_wait( &sound_thread_done, sound_thread_queued );
+}
+
+/* Hand the frame just recorded to the sound thread, and take back the one
+   before. Returns the number of samples in that, pointed to by `dest' */
+static long
+sound_thread_frame( libspectrum_dword frame_length, int ay,
+                    blip_sample_t **dest )
+{
+  sound_thread_frame_t *frame = sound_thread_current;
+
+  frame->frame_length = frame_length;
+  frame->ay = ay;
+  sound_thread_send( &sound_thread_todo, frame );
+  sound_thread_queued++;
+
+  /* The very first frame has nothing before it, so is a frame of silence */
+  if( sound_thread_queued == 1 ) {
+    sound_thread_current = frame == &sound_thread_frames[0] ?
+                           &sound_thread_frames[1] : &sound_thread_frames[0];
+    sound_thread_current->ay_change_count = 0;
+    sound_thread_current->edge_count = 0;
+
+    memset( samples, 0,
+            sound_framesiz * sound_channels * sizeof( blip_sample_t ) );
+    *dest = samples;
+    return ( sound_framesiz - 1 ) * sound_channels;
+  }
+
+  frame = sound_thread_receive( &sound_thread_done );
+  sound_thread_queued--;
+
+  sound_thread_current = frame;
+  frame->ay_change_count = 0;
+  frame->edge_count = 0;
+
+  *dest = frame->samples;
+  return frame->count;
+}
+
+static void
+sound_thread_ay_write( int reg, int val, libspectrum_dword now )
+{
+  sound_thread_frame_t *frame = sound_thread_current;
+  struct ay_change_tag *change;
+
+  if( frame->ay_change_count == frame->ay_change_allocated ) {
+    frame->ay_change_allocated = frame->ay_change_allocated ?
+      2 * frame->ay_change_allocated :
+      AY_CHANGE_FRAME_MAX( machine_current->timings.tstates_per_frame );
+    frame->ay_change =
+      libspectrum_realloc( frame->ay_change, frame->ay_change_allocated *
+                                             sizeof( *frame->ay_change ) );
+  }
+
+  change = &frame->ay_change[ frame->ay_change_count++ ];
+  change->tstates = now;
+  change->reg = reg;
+  change->val = val;
+}
+
+#endif				/* #ifdef HAVE_THREADS */
+
+/* blip_synth_update(), or left for the sound thread if there is one */
+static void
+sound_synth_update( Blip_Synth *synth, libspectrum_dword tstates, int val )
+{
+#ifdef HAVE_THREADS
+  if( sound_thread_running ) {
+    sound_thread_frame_t *frame = sound_thread_current;
+    struct sound_edge_tag *edge;
+
+    if( frame->edge_count == frame->edge_allocated ) {
+      frame->edge_allocated = frame->edge_allocated ?
+                              2 * frame->edge_allocated : 1024;
+      frame->edge =
+        libspectrum_realloc( frame->edge, frame->edge_allocated *
+                                          sizeof( *frame->edge ) );
+    }
+
+    edge = &frame->edge[ frame->edge_count++ ];
+    edge->tstates = tstates;
+    edge->synth = synth;
+    edge->val = val;
+    return;
+  }
+#endif				/* #ifdef HAVE_THREADS */
+
+  blip_synth_update( synth, tstates, val );
 }
 
 void
@@ -295,6 +599,9 @@ sound_init( const char *device )
   /* initialize movie settings... */
   movie_init_sound( settings_current.sound_freq, sound_stereo_ay );
 
+#ifdef HAVE_THREADS
+  if( sound_threaded ) sound_thread_start();
+#endif				/* #ifdef HAVE_THREADS */
 }
 
 void
@@ -318,6 +625,14 @@ void
 sound_end( void )
 {
   if( sound_enabled ) {
+#ifdef HAVE_THREADS
+    sound_thread_stop();
+#endif				/* #ifdef HAVE_THREADS */
+
+    /* No frame is coming to pass on the writes still queued, so do it
+       now to have the registers right when sound starts again */
+    ay_change_flush();
+
     delete_Blip_Synth( &left_beeper_synth );
     delete_Blip_Synth( &right_beeper_synth );
 
@@ -389,206 +704,429 @@ ay_do_tone( int level, unsigned int tone_count, int *var, int chan )
    master clock by 2 to drive the AY */
 #define AY_CLOCK_RATIO 2
 
+/* The AY is run in steps of AY_CLOCK_DIVISOR AY cycles. In each of them
+   the tone counters advance by AY_TONE_COUNT, and the envelope and noise
+   counters by one */
+#define AY_STEP ( AY_CLOCK_DIVISOR * AY_CLOCK_RATIO )
+#define AY_TONE_COUNT ( AY_CLOCK_DIVISOR >> 3 )
+
 static void
-sound_ay_overlay( void )
-{
-  static int rng = 1;
-  static int noise_toggle = 0;
-  static int env_first = 1, env_rev = 0, env_counter = 15;
-  int tone_level[3];
-  int mixer, envshape;
-  int g, level;
-  libspectrum_dword f;
-  struct ay_change_tag *change_ptr = ay_change;
-  int changes_left = ay_change_count;
-  int reg, r;
-  int chan1, chan2, chan3;
-  int last_chan1 = 0, last_chan2 = 0, last_chan3 = 0;
-  unsigned int tone_count, noise_count;
-
-  /* If no AY chip, don't produce any AY sound (!) */
-  if( !( periph_is_active( PERIPH_TYPE_FULLER) ||
-         periph_is_active( PERIPH_TYPE_MELODIK ) ||
-         machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_AY ) )
-    return;
+ay_register_changed( int reg )
+{
+  int r;
+
+  /* fix things as needed for some register changes */
+  switch ( reg ) {
+  case 0: case 1: case 2: case 3: case 4: case 5:
+    r = reg >> 1;
+    /* a zero-len period is the same as 1 */
+    ay_tone_period[r] = ( sound_ay_registers[ reg & ~1 ] |
+                          ( sound_ay_registers[ reg | 1 ] & 15 ) << 8 );
+    if( !ay_tone_period[r] )
+      ay_tone_period[r]++;
+
+    /* important to get this right, otherwise e.g. Ghouls 'n' Ghosts
+     * has really scratchy, horrible-sounding vibrato.
+     */
+    if( ay_tone_tick[r] >= ay_tone_period[r] * 2 )
+      ay_tone_tick[r] %= ay_tone_period[r] * 2;
+    break;
+  case 6:
+    ay_noise_tick = 0;
+    ay_noise_period = ( sound_ay_registers[ reg ] & 31 );
+    break;
+  case 11: case 12:
+    ay_env_period =
+      sound_ay_registers[11] | ( sound_ay_registers[12] << 8 );
+    break;
+  case 13:
+    ay_env_internal_tick = ay_env_tick = 0;
+    ay_env_first = 1;
+    ay_env_rev = 0;
+    ay_env_counter = ( sound_ay_registers[13] & AY_ENV_ATTACK ) ? 0 : 15;
+    break;
+  }
+}
 
-  for( f = 0; f < machine_current->timings.tstates_per_frame;
-       f+= AY_CLOCK_DIVISOR * AY_CLOCK_RATIO ) {
-    /* update ay registers. */
-    while( changes_left && f >= change_ptr->tstates ) {
-      sound_ay_registers[ reg = change_ptr->reg ] = change_ptr->val;
-      change_ptr++;
-      changes_left--;
-
-      /* fix things as needed for some register changes */
-      switch ( reg ) {
-      case 0: case 1: case 2: case 3: case 4: case 5:
-        r = reg >> 1;
-        /* a zero-len period is the same as 1 */
-        ay_tone_period[r] = ( sound_ay_registers[ reg & ~1 ] |
-                              ( sound_ay_registers[ reg | 1 ] & 15 ) << 8 );
-        if( !ay_tone_period[r] )
-          ay_tone_period[r]++;
-
-        /* important to get this right, otherwise e.g. Ghouls 'n' Ghosts
-         * has really scratchy, horrible-sounding vibrato.
-         */
-        if( ay_tone_tick[r] >= ay_tone_period[r] * 2 )
-          ay_tone_tick[r] %= ay_tone_period[r] * 2;
-        break;
-      case 6:
-        ay_noise_tick = 0;
-        ay_noise_period = ( sound_ay_registers[ reg ] & 31 );
-        break;
-      case 11: case 12:
-        ay_env_period =
-          sound_ay_registers[11] | ( sound_ay_registers[12] << 8 );
-        break;
-      case 13:
-        ay_env_internal_tick = ay_env_tick = ay_env_cycles = 0;
-        env_first = 1;
-        env_rev = 0;
-        env_counter = ( sound_ay_registers[13] & AY_ENV_ATTACK ) ? 0 : 15;
-        break;
-      }
-    }
+/* Move the envelope on by 1/16th of its period */
+static void
+ay_env_update( void )
+{
+  int envshape = sound_ay_registers[13];
+
+  /* do a 1/16th-of-period incr/decr if needed */
+  if( ay_env_first ||
+      ( ( envshape & AY_ENV_CONT ) && !( envshape & AY_ENV_HOLD ) ) ) {
+    if( ay_env_rev )
+      ay_env_counter -= ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
+    else
+      ay_env_counter += ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
+    if( ay_env_counter < 0 )
+      ay_env_counter = 0;
+    if( ay_env_counter > 15 )
+      ay_env_counter = 15;
+  }
+
+  ay_env_internal_tick++;
+  while( ay_env_internal_tick >= 16 ) {
+    ay_env_internal_tick -= 16;
 
-    /* the tone level if no enveloping is being used */
-    for( g = 0; g < 3; g++ )
-      tone_level[g] = ay_tone_levels[ sound_ay_registers[ 8 + g ] & 15 ];
-
-    /* envelope */
-    envshape = sound_ay_registers[13];
-    level = ay_tone_levels[ env_counter ];
-
-    for( g = 0; g < 3; g++ )
-      if( sound_ay_registers[ 8 + g ] & 16 )
-        tone_level[g] = level;
-
-    /* envelope output counter gets incr'd every 16 AY cycles. */
-    ay_env_cycles += AY_CLOCK_DIVISOR;
-    noise_count = 0;
-    while( ay_env_cycles >= 16 ) {
-      ay_env_cycles -= 16;
-      noise_count++;
-      ay_env_tick++;
-      while( ay_env_tick >= ay_env_period ) {
-        ay_env_tick -= ay_env_period;
-
-        /* do a 1/16th-of-period incr/decr if needed */
-        if( env_first ||
-            ( ( envshape & AY_ENV_CONT ) && !( envshape & AY_ENV_HOLD ) ) ) {
-          if( env_rev )
-            env_counter -= ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
-          else
-            env_counter += ( envshape & AY_ENV_ATTACK ) ? 1 : -1;
-          if( env_counter < 0 )
-            env_counter = 0;
-          if( env_counter > 15 )
-            env_counter = 15;
-        }
-
-        ay_env_internal_tick++;
-        while( ay_env_internal_tick >= 16 ) {
-          ay_env_internal_tick -= 16;
-
-          /* end of cycle */
-          if( !( envshape & AY_ENV_CONT ) )
-            env_counter = 0;
-          else {
-            if( envshape & AY_ENV_HOLD ) {
-              if( env_first && ( envshape & AY_ENV_ALT ) )
-                env_counter = ( env_counter ? 0 : 15 );
-            } else {
-              /* non-hold */
-              if( envshape & AY_ENV_ALT )
-                env_rev = !env_rev;
-              else
-                env_counter = ( envshape & AY_ENV_ATTACK ) ? 0 : 15;
-            }
-          }
-
-          env_first = 0;
-        }
-
-        /* don't keep trying if period is zero */
-        if( !ay_env_period )
-          break;
+    /* end of cycle */
+    if( !( envshape & AY_ENV_CONT ) )
+      ay_env_counter = 0;
+    else {
+      if( envshape & AY_ENV_HOLD ) {
+        if( ay_env_first && ( envshape & AY_ENV_ALT ) )
+          ay_env_counter = ( ay_env_counter ? 0 : 15 );
+      } else {
+        /* non-hold */
+        if( envshape & AY_ENV_ALT )
+          ay_env_rev = !ay_env_rev;
+        else
+          ay_env_counter = ( envshape & AY_ENV_ATTACK ) ? 0 : 15;
       }
     }
 
-    /* generate tone+noise... or neither.
-     * (if no tone/noise is selected, the chip just shoves the
-     * level out unmodified. This is used by some sample-playing
-     * stuff.)
-     */
-    chan1 = tone_level[0];
-    chan2 = tone_level[1];
-    chan3 = tone_level[2];
-    mixer = sound_ay_registers[7];
-
-    ay_tone_cycles += AY_CLOCK_DIVISOR;
-    tone_count = ay_tone_cycles >> 3;
-    ay_tone_cycles &= 7;
-
-    if( ( mixer & 1 ) == 0 ) {
-      level = chan1;
-      ay_do_tone( level, tone_count, &chan1, 0 );
-    }
-    if( ( mixer & 0x08 ) == 0 && noise_toggle )
-      chan1 = 0;
+    ay_env_first = 0;
+  }
+}
 
-    if( ( mixer & 2 ) == 0 ) {
-      level = chan2;
-      ay_do_tone( level, tone_count, &chan2, 1 );
-    }
-    if( ( mixer & 0x10 ) == 0 && noise_toggle )
-      chan2 = 0;
+/* Once through its first cycle, an envelope which doesn't repeat stays at
+   the same level for good */
+static int
+ay_env_frozen( void )
+{
+  int envshape = sound_ay_registers[13];
 
-    if( ( mixer & 4 ) == 0 ) {
-      level = chan3;
-      ay_do_tone( level, tone_count, &chan3, 2 );
-    }
-    if( ( mixer & 0x20 ) == 0 && noise_toggle )
-      chan3 = 0;
+  return !ay_env_first &&
+         ( !( envshape & AY_ENV_CONT ) || ( envshape & AY_ENV_HOLD ) );
+}
+
+static void
+ay_env_advance( libspectrum_dword steps )
+{
+  libspectrum_dword updates;
+
+  ay_env_tick += steps;
+
+  if( ay_env_period ) {
+    if( ay_env_tick < ay_env_period ) return;
+    updates = ay_env_tick / ay_env_period;
+    ay_env_tick %= ay_env_period;
+  } else {
+    /* don't keep trying if period is zero: one update a step */
+    updates = steps;
+  }
+
+  for( ; updates && !ay_env_frozen(); updates-- )
+    ay_env_update();
+
+  /* A frozen envelope just counts its way round the cycle */
+  ay_env_internal_tick = ( ay_env_internal_tick + updates ) & 15;
+}
+
+static void
+ay_noise_update( void )
+{
+  if( ( ay_rng & 1 ) ^ ( ( ay_rng & 2 ) ? 1 : 0 ) )
+    ay_noise_toggle = !ay_noise_toggle;
 
-    if( last_chan1 != chan1 ) {
-      blip_synth_update( ay_a_synth, f, chan1 );
-      if( ay_a_synth_r ) blip_synth_update( ay_a_synth_r, f, chan1 );
-      last_chan1 = chan1;
+  /* rng is 17-bit shift reg, bit 0 is output.
+   * input is bit 0 xor bit 3.
+   */
+  if( ay_rng & 1 ) {
+    ay_rng ^= 0x24000;
+  }
+  ay_rng >>= 1;
+}
+
+static void
+ay_noise_advance( libspectrum_dword steps )
+{
+  libspectrum_dword updates;
+
+  ay_noise_tick += steps;
+
+  if( ay_noise_period ) {
+    if( ay_noise_tick < ay_noise_period ) return;
+    updates = ay_noise_tick / ay_noise_period;
+    ay_noise_tick %= ay_noise_period;
+  } else {
+    /* don't keep trying if period is zero: one update a step */
+    updates = steps;
+  }
+
+  while( updates-- )
+    ay_noise_update();
+}
+
+/* Move tone channel `chan' on by `steps' steps without working out its
+   output; the same as calling ay_do_tone() that many times */
+static void
+ay_tone_advance( int chan, libspectrum_dword steps )
+{
+  unsigned int period = ay_tone_period[ chan ];
+  libspectrum_dword total;
+
+  if( !steps ) return;
+
+  /* The output flips every step */
+  if( period <= AY_TONE_COUNT ) {
+    ay_tone_tick[ chan ] += steps * ( AY_TONE_COUNT - period );
+    ay_tone_high[ chan ] ^= steps & 1;
+    return;
+  }
+
+  /* Only one period comes off the counter each step, so it may take a
+     couple to get back below a period which has just been shortened */
+  for( ; steps && ay_tone_tick[ chan ] >= period; steps-- ) {
+    ay_tone_tick[ chan ] += AY_TONE_COUNT - period;
+    ay_tone_high[ chan ] = !ay_tone_high[ chan ];
+  }
+
+  total = ay_tone_tick[ chan ] + steps * AY_TONE_COUNT;
+  ay_tone_tick[ chan ] = total % period;
+  ay_tone_high[ chan ] ^= ( total / period ) & 1;
+}
+
+/* Work out the AY's output for the step at `f' T-states into the frame,
+   passing on any change in each channel since `last_chan'. The tone
+   generators are moved on as part of this, but the envelope and noise
+   generators are left for ay_skip() */
+static void
+ay_step( libspectrum_dword f, int *last_chan )
+{
+  int tone_level[3], chan[3];
+  int mixer, g, level;
+
+  /* the tone level if no enveloping is being used */
+  for( g = 0; g < 3; g++ )
+    tone_level[g] = ay_tone_levels[ sound_ay_registers[ 8 + g ] & 15 ];
+
+  /* envelope */
+  level = ay_tone_levels[ ay_env_counter ];
+
+  for( g = 0; g < 3; g++ )
+    if( sound_ay_registers[ 8 + g ] & 16 )
+      tone_level[g] = level;
+
+  /* generate tone+noise... or neither.
+   * (if no tone/noise is selected, the chip just shoves the
+   * level out unmodified. This is used by some sample-playing
+   * stuff.)
+   */
+  mixer = sound_ay_registers[7];
+
+  for( g = 0; g < 3; g++ ) {
+    chan[g] = tone_level[g];
+
+    if( ( mixer & ( 0x01 << g ) ) == 0 ) {
+      level = chan[g];
+      ay_do_tone( level, AY_TONE_COUNT, &chan[g], g );
     }
-    if( last_chan2 != chan2 ) {
-      blip_synth_update( ay_b_synth, f, chan2 );
-      if( ay_b_synth_r ) blip_synth_update( ay_b_synth_r, f, chan2 );
-      last_chan2 = chan2;
+    if( ( mixer & ( 0x08 << g ) ) == 0 && ay_noise_toggle )
+      chan[g] = 0;
+  }
+
+  if( last_chan[0] != chan[0] ) {
+    blip_synth_update( ay_a_synth, f, chan[0] );
+    if( ay_a_synth_r ) blip_synth_update( ay_a_synth_r, f, chan[0] );
+    last_chan[0] = chan[0];
+  }
+  if( last_chan[1] != chan[1] ) {
+    blip_synth_update( ay_b_synth, f, chan[1] );
+    if( ay_b_synth_r ) blip_synth_update( ay_b_synth_r, f, chan[1] );
+    last_chan[1] = chan[1];
+  }
+  if( last_chan[2] != chan[2] ) {
+    blip_synth_update( ay_c_synth, f, chan[2] );
+    if( ay_c_synth_r ) blip_synth_update( ay_c_synth_r, f, chan[2] );
+    last_chan[2] = chan[2];
+  }
+}
+
+/* Finish off the step just run by ay_step(), then run through the
+   next `steps' - 1, in which the AY's output can't change */
+static void
+ay_skip( libspectrum_dword steps )
+{
+  int g;
+
+  /* envelope output counter gets incr'd every 16 AY cycles. */
+  ay_env_advance( steps );
+
+  for( g = 0; g < 3; g++ )
+    if( ( sound_ay_registers[7] & ( 0x01 << g ) ) == 0 )
+      ay_tone_advance( g, steps - 1 );
+
+  /* update noise RNG/filter */
+  ay_noise_advance( steps );
+}
+
+/* The first step after `step', or `next' if that's sooner, at which the
+   output of a channel which can be heard might change. Channels with no
+   volume are silent whatever their tone and noise generators do, and a
+   frozen envelope is just another fixed volume */
+static libspectrum_dword
+ay_next_change( libspectrum_dword step, libspectrum_dword next )
+{
+  int env_moving = !ay_env_frozen(), env_heard = 0, noise_heard = 0;
+  int mixer = sound_ay_registers[7];
+  libspectrum_dword wait;
+  int g;
+
+  for( g = 0; g < 3; g++ ) {
+    int volume = sound_ay_registers[ 8 + g ];
+
+    if( volume & 16 ) {
+      if( !env_moving && !ay_tone_levels[ ay_env_counter ] ) continue;
+      if( env_moving ) env_heard = 1;
+    } else if( !ay_tone_levels[ volume & 15 ] ) {
+      continue;
     }
-    if( last_chan3 != chan3 ) {
-      blip_synth_update( ay_c_synth, f, chan3 );
-      if( ay_c_synth_r ) blip_synth_update( ay_c_synth_r, f, chan3 );
-      last_chan3 = chan3;
+
+    /* A period of one gives a fixed level; see ay_do_tone() */
+    if( ( mixer & ( 0x01 << g ) ) == 0 && ay_tone_period[g] != 1 ) {
+      wait = ay_tone_tick[g] + AY_TONE_COUNT >= ay_tone_period[g] ? 1 :
+             ( ay_tone_period[g] - ay_tone_tick[g] + AY_TONE_COUNT - 1 ) /
+               AY_TONE_COUNT;
+      if( step + wait < next ) next = step + wait;
     }
 
-    /* update noise RNG/filter */
-    ay_noise_tick += noise_count;
-    while( ay_noise_tick >= ay_noise_period ) {
-      ay_noise_tick -= ay_noise_period;
+    if( ( mixer & ( 0x08 << g ) ) == 0 ) noise_heard = 1;
+  }
+
+  /* The noise and the envelope are updated at the end of each step, so
+     are heard from the step after */
+  if( noise_heard ) {
+    wait = !ay_noise_period || ay_noise_tick + 1 >= ay_noise_period ? 1 :
+           ay_noise_period - ay_noise_tick;
+    if( step + wait < next ) next = step + wait;
+  }
 
-      if( ( rng & 1 ) ^ ( ( rng & 2 ) ? 1 : 0 ) )
-        noise_toggle = !noise_toggle;
+  if( env_heard ) {
+    wait = !ay_env_period || ay_env_tick + 1 >= ay_env_period ? 1 :
+           ay_env_period - ay_env_tick;
+    if( step + wait < next ) next = step + wait;
+  }
 
-      /* rng is 17-bit shift reg, bit 0 is output.
-       * input is bit 0 xor bit 3.
-       */
-      if( rng & 1 ) {
-        rng ^= 0x24000;
-      }
-      rng >>= 1;
+  return next;
+}
+
+/* The AY is modelled in steps of AY_STEP T-states, but only those steps in
+   which its output might change are run in full: the next register write,
+   tone flip, noise change or envelope step on a channel which can be heard
+   is worked out in advance, and everything in between is skipped over */
+static void
+ay_change_apply( const struct ay_change_tag *change )
+{
+  sound_ay_registers[ change->reg ] = change->val;
+  ay_register_changed( change->reg );
+}
+
+static struct ay_change_tag*
+ay_change_at( size_t n )
+{
+  return &ay_change[ ( ay_change_start + n ) & ( ay_change_size - 1 ) ];
+}
+
+static void
+ay_change_drop_first( void )
+{
+  ay_change_start = ( ay_change_start + 1 ) & ( ay_change_size - 1 );
+  ay_change_count--;
+}
+
+/* Pass on every pending write straight away */
+static void
+ay_change_flush( void )
+{
+  while( ay_change_count ) {
+    ay_change_apply( ay_change_at( 0 ) );
+    ay_change_drop_first();
+  }
+}
+
+/* Make room for at least `size' pending writes */
+static void
+ay_change_resize( size_t size )
+{
+  struct ay_change_tag *new_change;
+  size_t new_size, i;
+
+  if( size <= ay_change_size ) return;
+
+  for( new_size = 1; new_size < size; new_size <<= 1 )
+    ;
+
+  new_change = libspectrum_malloc( new_size * sizeof( *new_change ) );
+  for( i = 0; i < ay_change_count; i++ )
+    new_change[i] = *ay_change_at( i );
 
-      /* don't keep trying if period is zero */
-      if( !ay_noise_period )
-        break;
+  libspectrum_free( ay_change );
+  ay_change = new_change;
+  ay_change_size = new_size;
+  ay_change_start = 0;
+}
+
+/* Queue a write to be passed on at the next frame, which is
+   `frame_length' T-states long. That comes from whoever recorded the
+   frame, as this may be running on the sound thread while the machine
+   changes under it */
+static void
+ay_change_add( const struct ay_change_tag *change,
+               libspectrum_dword frame_length )
+{
+  /* Only if frames are running long, or aren't being finished */
+  if( ay_change_count == ay_change_size )
+    ay_change_resize( ay_change_size ? 2 * ay_change_size :
+                      AY_CHANGE_FRAME_MAX( frame_length ) );
+
+  *ay_change_at( ay_change_count++ ) = *change;
+}
+
+int
+sound_ay_present( void )
+{
+  return periph_is_active( PERIPH_TYPE_FULLER) ||
+         periph_is_active( PERIPH_TYPE_MELODIK ) ||
+         machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_AY;
+}
+
+static void
+sound_ay_overlay( libspectrum_dword frame_length )
+{
+  int last_chan[3] = { 0, 0, 0 };
+  libspectrum_dword step, steps, next, change_step;
+  size_t i;
+
+  steps = ( frame_length + AY_STEP - 1 ) / AY_STEP;
+
+  for( step = 0; step < steps; step = next ) {
+    libspectrum_dword f = step * AY_STEP;
+
+    /* update ay registers. */
+    while( ay_change_count && f >= ay_change_at( 0 )->tstates ) {
+      ay_change_apply( ay_change_at( 0 ) );
+      ay_change_drop_first();
     }
+
+    ay_step( f, last_chan );
+
+    next = steps;
+    if( ay_change_count ) {
+      change_step = ( ay_change_at( 0 )->tstates + AY_STEP - 1 ) / AY_STEP;
+      if( change_step < next ) next = change_step;
+    }
+    next = ay_next_change( step, next );
+
+    ay_skip( next - step );
   }
+
+  /* Anything written after the last step, or after the end of the frame
+     if it ran long, is heard at the start of the next one */
+  for( i = 0; i < ay_change_count; i++ )
+    ay_change_at( i )->tstates = 0;
 }
 
 /* don't make the change immediately; record it for later,
@@ -597,14 +1135,57 @@ sound_ay_overlay( void )
 void
 sound_ay_write( int reg, int val, libspectrum_dword now )
 {
-  if( ay_change_count < AY_CHANGE_MAX ) {
-    ay_change[ ay_change_count ].tstates = now;
-    ay_change[ ay_change_count ].reg = ( reg & 15 );
-    ay_change[ ay_change_count ].val = val;
-    ay_change_count++;
+  struct ay_change_tag change;
+
+  if( sound_suspended ) return;
+
+  reg &= 15;
+
+  /* The I/O ports have nothing to do with the sound, and writing the same
+     value again to the mixer, volume or envelope period changes nothing;
+     the tone and noise periods and the envelope shape all restart
+     something when written to */
+  if( sound_ay_coalesce &&
+      ( reg >= 14 ||
+        ( reg >= 7 && reg <= 12 && ay_change_registers[ reg ] == val ) ) )
+    return;
+
+  ay_change_registers[ reg ] = val;
+
+#ifdef HAVE_THREADS
+  if( sound_thread_running ) {
+    sound_thread_ay_write( reg, val, now );
+    return;
+  }
+#endif				/* #ifdef HAVE_THREADS */
+
+  change.tstates = now;
+  change.reg = reg;
+  change.val = val;
+
+  if( sound_enabled ) {
+    ay_change_add( &change, machine_current->timings.tstates_per_frame );
+  } else {
+    ay_change_apply( &change );
   }
 }
 
+/* Catch the sound up with the AY's registers after frames in which it was
+   suspended. Only the registers which differ from what the sound already
+   has are written, as writing the envelope shape restarts the envelope
+   and the noise period the noise, even with the same value */
+void
+sound_ay_refresh( const libspectrum_byte *registers )
+{
+  int reg;
+
+  if( sound_suspended ) return;
+
+  for( reg = 0; reg < 14; reg++ )
+    if( registers[ reg ] != ay_change_registers[ reg ] )
+      sound_ay_write( reg, registers[ reg ], 0 );
+}
+
 /* no need to call this initially, but should be called
  * on reset otherwise.
  */
@@ -613,15 +1194,22 @@ sound_ay_reset( void )
 {
   int f;
 
+#ifdef HAVE_THREADS
+  /* Everything from here on is part of the next frame */
+  sound_thread_idle();
+  if( sound_thread_running ) sound_thread_current->ay_change_count = 0;
+#endif				/* #ifdef HAVE_THREADS */
+
   /* recalculate timings based on new machines ay clock */
   sound_ay_init();
 
-  ay_change_count = 0;
+  ay_change_resize(
+    AY_CHANGE_FRAME_MAX( machine_current->timings.tstates_per_frame ) );
+
   for( f = 0; f < 16; f++ )
     sound_ay_write( f, 0, 0 );
   for( f = 0; f < 3; f++ )
     ay_tone_high[f] = 0;
-  ay_tone_cycles = ay_env_cycles = 0;
 }
 
 /*
@@ -632,45 +1220,72 @@ void
 sound_specdrum_write( libspectrum_word port GCC_UNUSED, libspectrum_byte val )
 {
   if( periph_is_active( PERIPH_TYPE_SPECDRUM ) ) {
-    blip_synth_update( left_specdrum_synth, tstates, ( val - 128) * 128);
-    if( right_specdrum_synth ) {
-      blip_synth_update( right_specdrum_synth, tstates, ( val - 128) * 128);
+    if( !sound_suspended ) {
+      sound_synth_update( left_specdrum_synth, tstates, ( val - 128) * 128);
+      if( right_specdrum_synth ) {
+        sound_synth_update( right_specdrum_synth, tstates, ( val - 128) * 128);
+      }
     }
     machine_current->specdrum.specdrum_dac = val - 128;
   }
 }
 
-void
-sound_frame( void )
+/* Finish off a frame `frame_length' T-states long and read its samples
+   into `dest'; on the sound thread if there is one */
+static long
+sound_make_frame( libspectrum_dword frame_length, int ay,
+                  blip_sample_t *dest )
 {
   long count;
 
-  if( !sound_enabled )
-    return;
-
-  /* overlay AY sound */
-  sound_ay_overlay();
+  /* overlay AY sound; if no AY chip, don't produce any AY sound (!) */
+  if( ay ) {
+    sound_ay_overlay( frame_length );
+  } else {
+    ay_change_flush();
+  }
 
-  blip_buffer_end_frame( left_buf, machine_current->timings.tstates_per_frame );
+  blip_buffer_end_frame( left_buf, frame_length );
 
   if( sound_stereo_ay != SOUND_STEREO_AY_NONE ) {
-    blip_buffer_end_frame( right_buf, machine_current->timings.tstates_per_frame );
+    blip_buffer_end_frame( right_buf, frame_length );
 
     /* Read left channel into even samples, right channel into odd samples:
        LRLRLRLRLR... */
-    count = blip_buffer_read_samples( left_buf, samples, sound_framesiz, 1 );
-    blip_buffer_read_samples( right_buf, samples + 1, count, 1 );
+    count = blip_buffer_read_stereo_samples( left_buf, right_buf, dest,
+                                             sound_framesiz );
     count <<= 1;
   } else {
-    count = blip_buffer_read_samples( left_buf, samples, sound_framesiz, BLIP_BUFFER_DEF_STEREO );
+    count = blip_buffer_read_samples( left_buf, dest, sound_framesiz, BLIP_BUFFER_DEF_STEREO );
   }
 
+  return count;
+}
+
+void
+sound_frame( void )
+{
+  libspectrum_dword frame_length;
+  blip_sample_t *dest = samples;
+  long count;
+
+  if( !sound_enabled || sound_suspended )
+    return;
+
+  frame_length = machine_current->timings.tstates_per_frame;
+
+#ifdef HAVE_THREADS
+  if( sound_thread_running )
+    count = sound_thread_frame( frame_length, sound_ay_present(), &dest );
+  else
+#endif				/* #ifdef HAVE_THREADS */
+    count = sound_make_frame( frame_length, sound_ay_present(), dest );
+
   if( settings_current.sound ) 
-    sound_lowlevel_frame( samples, count );
+    sound_lowlevel_frame( dest, count );
 
   if( movie_recording )
-      movie_add_sound( samples, count );
-  ay_change_count = 0;
+      movie_add_sound( dest, count );
 }
 
 void
@@ -680,7 +1295,7 @@ sound_beeper( int on )
                                AMPL_BEEPER+AMPL_TAPE };
   int val;
 
-  if( !sound_enabled ) return;
+  if( !sound_enabled || sound_suspended ) return;
 
   if( tape_is_playing() ) {
     /* Timex machines have no loading noise */
@@ -693,7 +1308,7 @@ sound_beeper( int on )
 
   val = -beeper_ampl[3] + beeper_ampl[on]*2;
 
-  blip_synth_update( left_beeper_synth, tstates, val );
+  sound_synth_update( left_beeper_synth, tstates, val );
   if( sound_stereo_ay != SOUND_STEREO_AY_NONE )
-    blip_synth_update( right_beeper_synth, tstates, val );
+    sound_synth_update( right_beeper_synth, tstates, val );
 }
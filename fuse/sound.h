@@ -34,14 +34,30 @@ void sound_unpause( void );
 void sound_end( void );
 void sound_ay_write( int reg, int val, libspectrum_dword now );
 void sound_ay_reset( void );
+void sound_ay_refresh( const libspectrum_byte *registers );
+int sound_ay_present( void );
 void sound_specdrum_write( libspectrum_word port, libspectrum_byte val );
 void sound_frame( void );
 void sound_beeper( int on );
 libspectrum_dword sound_get_effective_processor_speed( void );
 
 extern int sound_enabled;
+
+/* While set, the machine makes no sound and none of the sound state
+   changes; for frames which are going to be rolled back or skipped. After
+   skipped ones, ay_sound_refresh() catches up with the AY's registers */
+extern int sound_suspended;
 extern int sound_framesiz;
 
+/* If set (the default), AY writes which can't make any difference to the
+   sound are dropped rather than being queued for the end of the frame */
+extern int sound_ay_coalesce;
+
+/* If set when the sound starts, the samples for each frame are made on a
+   thread of their own while the next frame is emulated, and so are passed
+   on a frame late. Only when built with HAVE_THREADS */
+extern int sound_threaded;
+
 /* Stereo separation types:
  *  * ACB is used in the Melodik interface.
  *  * ABC stereo is used in the Pentagon/Scorpion.
@@ -29,6 +29,7 @@ partially reimplemented in C by Gergely Szasz for FUSE
 
 
 static void _blip_synth_init( Blip_Synth_ * synth_, short *impulses );
+static void blip_synth_update_kernel( Blip_Synth * synth );
 
 inline void
 blip_buffer_set_clock_rate( Blip_Buffer * buff, long cps )
@@ -58,76 +59,54 @@ blip_synth_set_volume( Blip_Synth * synth, double v )
                                  ( BLIP_SYNTH_RANGE <
                                    0 ? -( BLIP_SYNTH_RANGE ) :
                                    BLIP_SYNTH_RANGE ) ) );
+  blip_synth_update_kernel( synth );
 }
 
-#define BLIP_FWD( i )                     \
-	t0 = i0 * delta + buf[fwd + i];   \
-	t1 = imp[BLIP_RES * (i + 1)] * delta + buf[fwd + 1 + i]; \
-	i0 = imp[BLIP_RES * (i + 2)];          \
-	buf[fwd + i] = t0;                     \
-	buf[fwd + 1 + i] = t1
+/* The impulse is stored interleaved by phase, so the BLIP_SYNTH_QUALITY
+   points of it to add in for any one phase are BLIP_RES apart, the first
+   half counting up from BLIP_RES - phase and the second half counting
+   down to phase. Copy them out so that each phase's points are together
+   and in order */
+static void
+blip_synth_update_kernel( Blip_Synth * synth )
+{
+  int phase, i;
+
+  for( phase = 0; phase < BLIP_RES; phase++ ) {
+    imp_t *kernel = synth->kernel + phase * BLIP_SYNTH_QUALITY;
 
-#define BLIP_REV( r ) \
-	t0 = i0 * delta + buf[rev - r];   \
-	t1 = imp[BLIP_RES * r] * delta + buf[rev + 1 - r];   \
-	i0 = imp[BLIP_RES * (r - 1)];          \
-	buf[rev - r] = t0;                     \
-	buf[rev + 1 - r] = t1
+    for( i = 0; i < BLIP_SYNTH_QUALITY / 2; i++ ) {
+      kernel[i] = synth->impulses[ BLIP_RES - phase + BLIP_RES * i ];
+      kernel[ BLIP_SYNTH_QUALITY - 1 - i ] =
+        synth->impulses[ phase + BLIP_RES * i ];
+    }
+  }
+}
 
 inline void
 blip_synth_offset_resampled( Blip_Synth * synth, blip_resampled_time_t time,
                              int delta, Blip_Buffer * blip_buf )
 {
-  int phase, fwd, rev, mid;
+  int phase, i;
 
-  imp_t *imp;
+  const imp_t *kernel;
 
-  long *buf, i0, t0, t1;
+  long *buf;
 
   delta *= synth->impl.delta_factor;
   phase =
     ( int )( time >> ( BLIP_BUFFER_ACCURACY - BLIP_PHASE_BITS ) &
              ( BLIP_RES - 1 ) );
-  imp = synth->impulses + BLIP_RES - phase;
-  buf = blip_buf->buffer_ + ( time >> BLIP_BUFFER_ACCURACY );
-  i0 = *imp;
-
-  fwd = ( BLIP_WIDEST_IMPULSE_ - BLIP_SYNTH_QUALITY ) / 2;
-  rev = fwd + BLIP_SYNTH_QUALITY - 2;
-
-  BLIP_FWD( 0 );
-  if( BLIP_SYNTH_QUALITY > 8 ) {
-    BLIP_FWD( 2 );
-  }
-  if( BLIP_SYNTH_QUALITY > 12 ) {
-    BLIP_FWD( 4 );
-  }
-
-  mid = BLIP_SYNTH_QUALITY / 2 - 1;
-  t0 = i0 * delta + buf[fwd + mid - 1];
-  t1 = imp[BLIP_RES * mid] * delta + buf[fwd + mid];
-  imp = synth->impulses + phase;
-  i0 = imp[BLIP_RES * mid];
-  buf[fwd + mid - 1] = t0;
-  buf[fwd + mid] = t1;
-
-  if( BLIP_SYNTH_QUALITY > 12 ) {
-    BLIP_REV( 6 );
-  }
-  if( BLIP_SYNTH_QUALITY > 8 ) {
-    BLIP_REV( 4 );
-  }
-  BLIP_REV( 2 );
-
-  t0 = i0 * delta + buf[rev];
-  t1 = *imp * delta + buf[rev + 1];
-  buf[rev] = t0;
-  buf[rev + 1] = t1;
+  kernel = synth->kernel + phase * BLIP_SYNTH_QUALITY;
+  buf = blip_buf->buffer_ + ( time >> BLIP_BUFFER_ACCURACY ) +
+        ( BLIP_WIDEST_IMPULSE_ - BLIP_SYNTH_QUALITY ) / 2;
+
+  /* One multiply-add per point, all independent of each other, which the
+     compiler can vectorise where the target has a widening multiply */
+  for( i = 0; i < BLIP_SYNTH_QUALITY; i++ )
+    buf[i] += ( long )kernel[i] * delta;
 }
 
-#undef BLIP_FWD
-#undef BLIP_REV
-
 void
 blip_synth_update( Blip_Synth * synth, blip_time_t t, int amp )
 {
@@ -154,6 +133,7 @@ blip_synth_set_treble_eq( Blip_Synth * synth, double treble )
   eq.treble = treble;
 
   _blip_synth_treble_eq( &synth->impl, &eq );
+  blip_synth_update_kernel( synth );
 }
 
 #define BUFFER_EXTRA ( BLIP_WIDEST_IMPULSE_ + 2 )
@@ -210,6 +190,8 @@ blip_synth_init( Blip_Synth * synth )
   synth->impulses =
     malloc( ( BLIP_RES * ( BLIP_SYNTH_QUALITY / 2 ) +
               1 ) * sizeof( imp_t ) * 4 );
+  synth->kernel =
+    calloc( BLIP_RES * BLIP_SYNTH_QUALITY, sizeof( imp_t ) );
   if( synth->impulses ) {
     _blip_synth_init( &synth->impl, ( short * )synth->impulses );       /* sorry, somewhere imp_t, somewhere short ???? */
   }
@@ -222,6 +204,10 @@ blip_synth_end( Blip_Synth * synth )
     free( synth->impulses );
     synth->impulses = NULL;
   }
+  if( synth->kernel ) {
+    free( synth->kernel );
+    synth->kernel = NULL;
+  }
 }
 
 Blip_Synth *
@@ -232,7 +218,8 @@ new_Blip_Synth( void )
   ret = malloc( sizeof( Blip_Synth ) );
   if( ret ) {
     blip_synth_init( ret );
-    if( !ret->impulses ) {
+    if( !ret->impulses || !ret->kernel ) {
+      blip_synth_end( ret );
       free( ret );
       return NULL;
     }
@@ -615,3 +602,62 @@ blip_buffer_read_samples( Blip_Buffer * buff, blip_sample_t * out,
 
   return count;
 }
+
+long
+blip_buffer_read_stereo_samples( Blip_Buffer * left, Blip_Buffer * right,
+                                 blip_sample_t * out, long max_samples )
+{
+  long count = blip_buffer_samples_avail( left );
+
+  if( count > blip_buffer_samples_avail( right ) )
+    count = blip_buffer_samples_avail( right );
+  if( count > max_samples )
+    count = max_samples;
+
+  if( count ) {
+    int sample_shift = BLIP_SAMPLE_BITS - 16;
+
+    int left_bass_shift = left->bass_shift;
+
+    int right_bass_shift = right->bass_shift;
+
+    long left_accum = left->reader_accum;
+
+    long right_accum = right->reader_accum;
+
+    buf_t_ *left_in = left->buffer_;
+
+    buf_t_ *right_in = right->buffer_;
+
+    int n;
+
+    /* the two filters don't depend on each other, so working on both at
+       once keeps the processor busy while each waits for its last result */
+    for( n = count; n--; ) {
+      long l = left_accum >> sample_shift;
+
+      long r = right_accum >> sample_shift;
+
+      left_accum -= left_accum >> left_bass_shift;
+      left_accum += *left_in++;
+      right_accum -= right_accum >> right_bass_shift;
+      right_accum += *right_in++;
+
+      /* clamp samples */
+      out[0] = ( blip_sample_t ) l;
+      if( ( blip_sample_t ) l != l )
+        out[0] = ( blip_sample_t ) ( 0x7FFF - ( l >> 24 ) );
+      out[1] = ( blip_sample_t ) r;
+      if( ( blip_sample_t ) r != r )
+        out[1] = ( blip_sample_t ) ( 0x7FFF - ( r >> 24 ) );
+      out += 2;
+    }
+
+    left->reader_accum = left_accum;
+    right->reader_accum = right_accum;
+    blip_buffer_remove_samples( left, count );
+    blip_buffer_remove_samples( right, count );
+  }
+
+  return count;
+}
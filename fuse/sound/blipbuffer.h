@@ -105,6 +105,13 @@ void blip_buffer_end_frame( Blip_Buffer * buff, blip_time_t time );
 long blip_buffer_read_samples( Blip_Buffer * buff, blip_sample_t * dest,
                                long max_samples, int stereo );
 
+/*  Read at most 'max_samples' out of both 'left' and 'right' into 'dest' as
+ interleaved stereo pairs, in a single pass. Returns number of pairs read.
+*/
+long blip_buffer_read_stereo_samples( Blip_Buffer * left, Blip_Buffer * right,
+                                      blip_sample_t * dest,
+                                      long max_samples );
+
 /*  Additional optional features */
 
 /*  Set frequency high-pass filter frequency, where higher values reduce bass more */
@@ -184,6 +191,7 @@ typedef short imp_t;
 
 typedef struct Blip_Synth_s {
   imp_t *impulses;
+  imp_t *kernel;                /* impulses rearranged by phase */
   Blip_Synth_ impl;
 } Blip_Synth;
 
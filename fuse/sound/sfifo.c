@@ -9,6 +9,8 @@
  * Modifications by Philip Kendall (c) 2007
  * This modified version is released under the GNU GENERAL PUBLIC LICENSE
  * version 2, or any later version
+
+ * Memory barriers added by Fuse contributors (c) 2016
 -----------------------------------------------------------
 TODO:
 	* Is there a way to avoid losing one byte of buffer
@@ -34,6 +36,17 @@ TODO:
 
 #include "sfifo.h"
 
+/*
+ * Make sure the data is there before the other side is told about it,
+ * and isn't overwritten until it has been read, on CPUs which may
+ * reorder memory accesses (ARM, PowerPC, ...)
+ */
+#ifdef __GNUC__
+#	define	SFIFO_BARRIER()	__sync_synchronize()
+#else
+#	define	SFIFO_BARRIER()
+#endif
+
 #ifdef _SFIFO_TEST_
 #include <stdio.h>
 #include <unistd.h>
@@ -115,6 +128,7 @@ int sfifo_write(sfifo_t *f, const void *_buf, int len)
 		len = total;
 	else
 		total = len;
+	SFIFO_BARRIER();
 
 	i = f->writepos;
 	if(i + len > f->size)
@@ -125,6 +139,7 @@ int sfifo_write(sfifo_t *f, const void *_buf, int len)
 		i = 0;
 	}
 	memcpy(f->buffer + i, buf, len);
+	SFIFO_BARRIER();
 	f->writepos = i + len;
 
 	return total;
@@ -190,6 +205,7 @@ int sfifo_read(sfifo_t *f, void *_buf, int len)
 		len = total;
 	else
 		total = len;
+	SFIFO_BARRIER();
 
 	i = f->readpos;
 	if(i + len > f->size)
@@ -200,6 +216,7 @@ int sfifo_read(sfifo_t *f, void *_buf, int len)
 		i = 0;
 	}
 	memcpy(buf, f->buffer + i, len);
+	SFIFO_BARRIER();
 	f->readpos = i + len;
 
 	return total;
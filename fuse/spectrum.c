@@ -35,7 +35,9 @@
 #include "loader.h"
 #include "machine.h"
 #include "memory.h"
+#include "perf.h"
 #include "peripherals/printer.h"
+#include "peripherals/ula.h"
 #include "psg.h"
 #include "profile.h"
 #include "rzx.h"
@@ -88,10 +90,17 @@ spectrum_init( void )
 					 "End of frame" );
 }
 
+PERF_COUNTER( spectrum_frame );
+PERF_COUNTER( sound_frame );
+PERF_COUNTER( display_frame );
+
 int
 spectrum_frame( void )
 {
   libspectrum_dword frame_length;
+  int error;
+
+  PERF_START( spectrum_frame );
 
   /* Reduce the t-state count of both the processor and all the events
      scheduled to occur. Done slightly differently if RZX playback is
@@ -104,9 +113,19 @@ spectrum_frame( void )
   if( z80.interrupts_enabled_at >= 0 )
     z80.interrupts_enabled_at -= frame_length;
 
-  if( sound_enabled ) sound_frame();
+  if( sound_enabled ) {
+    PERF_START( sound_frame );
+    sound_frame();
+    PERF_STOP( sound_frame );
+  }
 
-  if( display_frame() ) return 1;
+  PERF_START( display_frame );
+  error = display_frame();
+  PERF_STOP( display_frame );
+  if( error ) {
+    PERF_STOP( spectrum_frame );
+    return 1;
+  }
   if( profile_active ) profile_frame( frame_length );
   printer_frame();
 
@@ -114,9 +133,12 @@ spectrum_frame( void )
   if( !rzx_playback )
     event_add( machine_current->timings.tstates_per_frame,
                spectrum_frame_event );
+  ula_contention_events_add();
 
   loader_frame( frame_length );
 
+  PERF_STOP( spectrum_frame );
+
   return 0;
 }
 
@@ -0,0 +1,264 @@
+/* state.c: Native in-memory savestates
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#include <config.h>
+
+#include <string.h>
+#include <time.h>
+
+#include <libspectrum.h>
+
+#include "display.h"
+#include "event.h"
+#include "machine.h"
+#include "memory.h"
+#include "module.h"
+#include "periph.h"
+#include "peripherals/dck.h"
+#include "peripherals/disk/beta.h"
+#include "peripherals/if2.h"
+#include "rzx.h"
+#include "settings.h"
+#include "state.h"
+
+/*
+ * The layout is
+ *
+ *   header   magic, version, machine, late timings and module section size
+ *   modules  each module's state_save output, in registration order; the
+ *            Z80's, with the T-state count, comes first
+ *   events   the pending event list
+ *   RAM      the touched 4Kb pages
+ *
+ * and is padded with zeroes to state_size() bytes.
+ */
+
+static const libspectrum_byte state_magic[4] = { 'F', 'N', 'S', 'T' };
+
+#define STATE_VERSION 4
+
+#define STATE_HEADER_LENGTH ( 4 + 1 + 4 + 1 + 4 )
+
+/* The section sizes depend only on the machine, so are worked out once
+   when it changes rather than on every call */
+static const fuse_machine_info *state_sized_machine = NULL;
+static size_t state_modules_length, state_total_length;
+
+static void
+state_update_size( void )
+{
+  if( machine_current == state_sized_machine ) return;
+
+  state_modules_length = module_state_size();
+  state_total_length = STATE_HEADER_LENGTH + state_modules_length +
+                       event_state_size() + memory_state_ram_size();
+  state_sized_machine = machine_current;
+}
+
+/* Peripherals with state this format doesn't cover */
+static const periph_type state_unsupported[] = {
+  PERIPH_TYPE_DIVIDE,
+  PERIPH_TYPE_DISCIPLE,
+  PERIPH_TYPE_INTERFACE1,
+  PERIPH_TYPE_OPUS,
+  PERIPH_TYPE_PLUSD,
+  PERIPH_TYPE_SE_MEMORY,
+  PERIPH_TYPE_SIMPLEIDE,
+  PERIPH_TYPE_SPECCYBOOT,
+  PERIPH_TYPE_SPECDRUM,
+  PERIPH_TYPE_SPECTRANET,
+  PERIPH_TYPE_ZXATASP,
+  PERIPH_TYPE_ZXCF,
+  PERIPH_TYPE_UNKNOWN
+};
+
+int
+state_available( void )
+{
+  const periph_type *type;
+
+  if( rzx_playback || rzx_recording ) return 0;
+
+  /* We rely on the ROMs being the same when the state is read back */
+  if( memory_custom_rom() || settings_current.writable_roms ) return 0;
+
+  /* The Interface 2 slot only matters with a cartridge in it */
+  if( dck_active || if2_active ) return 0;
+
+  for( type = state_unsupported; *type != PERIPH_TYPE_UNKNOWN; type++ )
+    if( periph_is_active( *type ) ) return 0;
+
+  if( periph_is_active( PERIPH_TYPE_BETA128 ) &&
+      beta_memory_map_romcs[0].save_to_snapshot ) return 0;
+
+  return event_state_available();
+}
+
+size_t
+state_size( void )
+{
+  state_update_size();
+  return state_total_length;
+}
+
+int
+state_write( libspectrum_byte *buffer, size_t length )
+{
+  libspectrum_byte *ptr = buffer;
+  size_t size = state_size();
+
+  if( length < size ) return 1;
+
+  state_write_block( &ptr, state_magic, sizeof( state_magic ) );
+  state_write_byte( &ptr, STATE_VERSION );
+  state_write_dword( &ptr, machine_current->machine );
+  state_write_byte( &ptr, settings_current.late_timings );
+  state_write_dword( &ptr, state_modules_length );
+
+  module_state_save( &ptr );
+  event_state_save( &ptr );
+  memory_state_ram_save( &ptr );
+
+  /* Keep the unused tail deterministic for rewind and netplay */
+  memset( ptr, 0, buffer + length - ptr );
+
+  return 0;
+}
+
+int
+state_identify( const libspectrum_byte *buffer, size_t length )
+{
+  return length >= STATE_HEADER_LENGTH &&
+         !memcmp( buffer, state_magic, sizeof( state_magic ) ) &&
+         buffer[4] == STATE_VERSION;
+}
+
+int
+state_read( const libspectrum_byte *buffer, size_t length )
+{
+  const libspectrum_byte *ptr = buffer, *end = buffer + length;
+  const libspectrum_byte *events, *ram;
+  libspectrum_machine machine;
+  libspectrum_dword modules_length;
+  size_t events_length;
+  int late_timings, error;
+
+  if( !state_identify( buffer, length ) ) return 1;
+  ptr += 5;
+
+  machine = state_read_dword( &ptr );
+  late_timings = state_read_byte( &ptr );
+  modules_length = state_read_dword( &ptr );
+
+  /* Only switch machine if we have to; otherwise everything is restored
+     on top of the running one */
+  if( machine != machine_current->machine ||
+      late_timings != settings_current.late_timings ) {
+    settings_current.late_timings = late_timings;
+    if( machine != machine_current->machine ) {
+      error = machine_select( machine ); if( error ) return error;
+    } else {
+      machine_reset( 0 );
+    }
+  }
+
+  state_update_size();
+  if( modules_length != state_modules_length ||
+      (size_t)( end - ptr ) < modules_length ) return 1;
+
+  events = ptr + modules_length;
+  events_length = event_state_check( events, end - events );
+  if( !events_length ) return 1;
+
+  ram = events + events_length;
+  if( !memory_state_ram_check( ram, end - ram ) ) return 1;
+
+  /* Events go first so that modules may cancel the ones they own */
+  event_state_load( &events );
+  module_state_load( &ptr );
+  memory_state_ram_load( &ram );
+
+  /* As for snapshots, rebuild the memory map after every module has had
+     its say */
+  machine_current->memory_map();
+  display_refresh_all();
+
+  return 0;
+}
+
+/* machine, late timings, modules and events */
+#define STATE_MACHINE_HEADER_LENGTH ( 4 + 1 )
+
+size_t
+state_machine_size( void )
+{
+  state_update_size();
+  return STATE_MACHINE_HEADER_LENGTH + state_modules_length +
+         event_state_size();
+}
+
+void
+state_machine_write( libspectrum_byte *buffer )
+{
+  libspectrum_byte *ptr = buffer;
+
+  state_write_dword( &ptr, machine_current->machine );
+  state_write_byte( &ptr, settings_current.late_timings );
+
+  module_state_save( &ptr );
+  event_state_save( &ptr );
+}
+
+int
+state_machine_read( const libspectrum_byte *buffer, size_t length )
+{
+  const libspectrum_byte *ptr = buffer, *end = buffer + length;
+  const libspectrum_byte *events;
+
+  if( length < STATE_MACHINE_HEADER_LENGTH ) return 1;
+
+  if( state_read_dword( &ptr ) != machine_current->machine ||
+      state_read_byte( &ptr ) != settings_current.late_timings )
+    return 1;
+
+  state_update_size();
+  if( (size_t)( end - ptr ) < state_modules_length ) return 1;
+
+  events = ptr + state_modules_length;
+  if( !event_state_check( events, end - events ) ) return 1;
+
+  event_state_load( &events );
+  module_state_load( &ptr );
+
+  machine_current->memory_map();
+
+  return 0;
+}
+
+libspectrum_dword
+state_session( void )
+{
+  static libspectrum_dword session = 0;
+
+  while( !session )
+    session = (libspectrum_dword)time( NULL ) ^
+              (libspectrum_dword)(size_t)&session;
+
+  return session;
+}
@@ -0,0 +1,125 @@
+/* state.h: Native in-memory savestates
+   Copyright (c) 2016 Fuse contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+*/
+
+#ifndef FUSE_STATE_H
+#define FUSE_STATE_H
+
+#include <string.h>
+
+#include <libspectrum.h>
+
+/* A fixed-layout snapshot of the running machine, intended for rewind,
+   run-ahead and netplay rather than for interchange: it is only valid
+   for the same build of Fuse with the same ROMs loaded. RAM is written
+   as the list of 4Kb pages which have been touched since power on, so
+   most of the memory of the larger machines is never copied. Anything
+   this format cannot represent makes state_available() return 0, and
+   the caller should fall back to SZX */
+
+/* Can the current machine be saved in the native format? */
+int state_available( void );
+
+/* The number of bytes state_write() needs; fixed for each machine */
+size_t state_size( void );
+
+/* Save the machine into `buffer'; returns non-zero if it doesn't fit */
+int state_write( libspectrum_byte *buffer, size_t length );
+
+/* Does `buffer' look like a native state? */
+int state_identify( const libspectrum_byte *buffer, size_t length );
+
+/* Restore the machine from `buffer' */
+int state_read( const libspectrum_byte *buffer, size_t length );
+
+/* The same, less the RAM, for rollback.c, which keeps track of that
+   itself. state_machine_size() is also fixed for each machine, and
+   state_machine_read() only restores onto the machine and timings the
+   state was taken from, leaving RAM as it is. Nor does it redraw the
+   screen: the caller knows which parts of RAM it has put back */
+size_t state_machine_size( void );
+void state_machine_write( libspectrum_byte *buffer );
+int state_machine_read( const libspectrum_byte *buffer, size_t length );
+
+/* Identifies this run of Fuse, for state which is only meaningful
+   in-process */
+libspectrum_dword state_session( void );
+
+/* Helpers for the module state_save and state_load hooks. All values are
+   stored little-endian so that states can be exchanged over netplay */
+
+static inline void
+state_write_byte( libspectrum_byte **ptr, libspectrum_byte b )
+{
+  *(*ptr)++ = b;
+}
+
+static inline void
+state_write_word( libspectrum_byte **ptr, libspectrum_word w )
+{
+  *(*ptr)++ = w & 0xff;
+  *(*ptr)++ = w >> 8;
+}
+
+static inline void
+state_write_dword( libspectrum_byte **ptr, libspectrum_dword d )
+{
+  *(*ptr)++ = ( d       ) & 0xff;
+  *(*ptr)++ = ( d >>  8 ) & 0xff;
+  *(*ptr)++ = ( d >> 16 ) & 0xff;
+  *(*ptr)++ = ( d >> 24 ) & 0xff;
+}
+
+static inline void
+state_write_block( libspectrum_byte **ptr, const void *data, size_t length )
+{
+  memcpy( *ptr, data, length ); *ptr += length;
+}
+
+static inline libspectrum_byte
+state_read_byte( const libspectrum_byte **ptr )
+{
+  return *(*ptr)++;
+}
+
+static inline libspectrum_word
+state_read_word( const libspectrum_byte **ptr )
+{
+  libspectrum_word w = (*ptr)[0] | ( (*ptr)[1] << 8 );
+  *ptr += 2;
+  return w;
+}
+
+static inline libspectrum_dword
+state_read_dword( const libspectrum_byte **ptr )
+{
+  libspectrum_dword d = (libspectrum_dword)(*ptr)[0]         |
+                        (libspectrum_dword)(*ptr)[1] <<  8   |
+                        (libspectrum_dword)(*ptr)[2] << 16   |
+                        (libspectrum_dword)(*ptr)[3] << 24;
+  *ptr += 4;
+  return d;
+}
+
+static inline void
+state_read_block( const libspectrum_byte **ptr, void *data, size_t length )
+{
+  memcpy( data, *ptr, length ); *ptr += length;
+}
+
+#endif			/* #ifndef FUSE_STATE_H */
@@ -38,11 +38,13 @@
 #include "loader.h"
 #include "machine.h"
 #include "memory.h"
+#include "module.h"
 #include "peripherals/ula.h"
 #include "settings.h"
 #include "sound.h"
 #include "settings.h"
 #include "snapshot.h"
+#include "state.h"
 #include "tape.h"
 #include "timer/timer.h"
 #include "ui/ui.h"
@@ -76,6 +78,10 @@ static int play_event, stop_event = -1;
 int tape_edge_event;
 static int record_event;
 
+/* Bumped whenever a different tape is inserted, so a native state knows
+   whether its playback position still refers to the current tape */
+static libspectrum_dword tape_generation;
+
 /* Function prototypes */
 
 static int tape_autoload( libspectrum_machine hardware );
@@ -86,6 +92,22 @@ static void make_name( unsigned char *name, const unsigned char *data );
 static void
 tape_event_record_sample( libspectrum_dword last_tstates, int type,
 			  void *user_data );
+static size_t tape_state_size( void );
+static void tape_state_save( libspectrum_byte **ptr );
+static void tape_state_load( const libspectrum_byte **ptr );
+
+static module_info_t tape_module_info = {
+
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  tape_state_size,
+  tape_state_save,
+  tape_state_load,
+
+};
 
 /* Function definitions */
 
@@ -109,6 +131,8 @@ tape_init( void )
      so we can't update the statusbar */
   tape_playing = 0;
   tape_microphone = 0;
+
+  module_register( &tape_module_info );
 }
 
 void
@@ -146,6 +170,8 @@ tape_read_buffer( unsigned char *buffer, size_t length, libspectrum_id_t type,
     error = tape_close(); if( error ) return error;
   }
 
+  tape_generation++;
+
   error = libspectrum_tape_read( tape, buffer, length, type, filename );
   if( error ) return error;
 
@@ -231,6 +257,7 @@ int tape_close( void )
   }
 
   /* And then remove it from memory */
+  tape_generation++;
   error = libspectrum_tape_clear( tape );
   if( error ) return error;
 
@@ -1031,3 +1058,58 @@ make_name( unsigned char *name, const unsigned char *data )
 
   *name = '\0';
 }
+
+static size_t
+tape_state_size( void )
+{
+  return 3 + 4 + 4 + libspectrum_tape_position_state_length();
+}
+
+static void
+tape_state_save( libspectrum_byte **ptr )
+{
+  state_write_byte( ptr, tape_playing );
+  state_write_byte( ptr, tape_autoplay );
+  state_write_byte( ptr, tape_microphone );
+  state_write_dword( ptr, state_session() );
+  state_write_dword( ptr, tape_generation );
+
+  libspectrum_tape_position_state_get( tape, *ptr );
+  *ptr += libspectrum_tape_position_state_length();
+}
+
+static void
+tape_state_load( const libspectrum_byte **ptr )
+{
+  int playing = state_read_byte( ptr );
+  int autoplay = state_read_byte( ptr );
+  int microphone = state_read_byte( ptr );
+  libspectrum_dword session = state_read_dword( ptr );
+  libspectrum_dword generation = state_read_dword( ptr );
+  const libspectrum_byte *position = *ptr;
+
+  *ptr += libspectrum_tape_position_state_length();
+
+  /* If the state refers to some other tape, just stop the current one as
+     loading a snapshot would */
+  if( session != state_session() || generation != tape_generation ) {
+    tape_stop();
+    return;
+  }
+
+  libspectrum_tape_position_state_set( tape, position );
+
+  if( playing && !tape_playing ) {
+    /* As tape_play(), but the next edge is already in the restored event
+       list */
+    tape_playing = 1;
+    ui_statusbar_update( UI_STATUSBAR_ITEM_TAPE, UI_STATUSBAR_STATE_ACTIVE );
+    if( settings_current.fastload ) sound_pause();
+    loader_tape_play();
+  } else if( !playing && tape_playing ) {
+    tape_stop();
+  }
+
+  tape_autoplay = autoplay;
+  tape_microphone = microphone;
+}
@@ -52,6 +52,12 @@ void uidisplay_spectrum_screen( const libspectrum_byte *screen, int border );
 void uidisplay_putpixel( int x, int y, int colour );
 void uidisplay_plot8( int x, int y, libspectrum_byte data, libspectrum_byte ink,
                       libspectrum_byte paper );
+/* Plot `count' consecutive 8x1 chunks starting at chunk ( x, y ), the
+   i'th using data[i], ink[i] and paper[i] */
+void uidisplay_plot8_run( int x, int y, int count,
+                          const libspectrum_byte *data,
+                          const libspectrum_byte *ink,
+                          const libspectrum_byte *paper );
 void uidisplay_plot16( int x, int y, libspectrum_word data, libspectrum_byte ink,
                        libspectrum_byte paper);
 
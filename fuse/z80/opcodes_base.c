@@ -506,8 +506,9 @@
       writebyte(HL,L);
       break;
     case 0x76:		/* HALT */
-      z80.halted=1;
       PC--;
+      if( z80.halted ) HALT_FAST_FORWARD();
+      z80.halted=1;
       break;
     case 0x77:		/* LD (HL),A */
       writebyte(HL,A);
@@ -33,6 +33,7 @@
 #include "peripherals/spectranet.h"
 #include "rzx.h"
 #include "spectrum.h"
+#include "state.h"
 #include "ui/ui.h"
 #include "z80.h"
 #include "z80_macros.h"
@@ -67,6 +68,9 @@ int z80_interrupt_event, z80_nmi_event;
 static void z80_init_tables(void);
 static void z80_from_snapshot( libspectrum_snap *snap );
 static void z80_to_snapshot( libspectrum_snap *snap );
+static size_t z80_state_size( void );
+static void z80_state_save( libspectrum_byte **ptr );
+static void z80_state_load( const libspectrum_byte **ptr );
 static void z80_nmi( libspectrum_dword ts, int type, void *user_data );
 
 static module_info_t z80_module_info = {
@@ -76,6 +80,9 @@ static module_info_t z80_module_info = {
   NULL,
   z80_from_snapshot,
   z80_to_snapshot,
+  z80_state_size,
+  z80_state_save,
+  z80_state_load,
 
 };
 
@@ -283,3 +290,50 @@ z80_to_snapshot( libspectrum_snap *snap )
     snap, z80.interrupts_enabled_at == tstates
   );
 }
+
+/* Routines for transferring the Z80 contents to and from native states */
+
+static size_t
+z80_state_size( void )
+{
+  return 13 * 2 + 2 + 3 + 1 + 4 + 4;
+}
+
+static void
+z80_state_save( libspectrum_byte **ptr )
+{
+  state_write_word( ptr, AF  ); state_write_word( ptr, BC  );
+  state_write_word( ptr, DE  ); state_write_word( ptr, HL  );
+  state_write_word( ptr, AF_ ); state_write_word( ptr, BC_ );
+  state_write_word( ptr, DE_ ); state_write_word( ptr, HL_ );
+  state_write_word( ptr, IX  ); state_write_word( ptr, IY  );
+  state_write_word( ptr, SP  ); state_write_word( ptr, PC  );
+  state_write_word( ptr, z80.r );
+
+  state_write_byte( ptr, I ); state_write_byte( ptr, R7 );
+  state_write_byte( ptr, IFF1 ); state_write_byte( ptr, IFF2 );
+  state_write_byte( ptr, IM );
+  state_write_byte( ptr, z80.halted );
+  state_write_dword( ptr, z80.interrupts_enabled_at );
+  state_write_dword( ptr, tstates );
+}
+
+static void
+z80_state_load( const libspectrum_byte **ptr )
+{
+  AF  = state_read_word( ptr ); BC  = state_read_word( ptr );
+  DE  = state_read_word( ptr ); HL  = state_read_word( ptr );
+  AF_ = state_read_word( ptr ); BC_ = state_read_word( ptr );
+  DE_ = state_read_word( ptr ); HL_ = state_read_word( ptr );
+  IX  = state_read_word( ptr ); IY  = state_read_word( ptr );
+  SP  = state_read_word( ptr ); PC  = state_read_word( ptr );
+  z80.r = state_read_word( ptr );
+
+  I = state_read_byte( ptr ); R7 = state_read_byte( ptr );
+  IFF1 = state_read_byte( ptr ); IFF2 = state_read_byte( ptr );
+  IM = state_read_byte( ptr );
+  z80.halted = state_read_byte( ptr );
+  z80.interrupts_enabled_at =
+    (libspectrum_signed_dword)state_read_dword( ptr );
+  tstates = state_read_dword( ptr );
+}
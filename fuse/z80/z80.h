@@ -63,6 +63,15 @@ void z80_retn( void );
 
 void z80_do_opcodes(void);
 
+/* Whether to run a copy of the core which doesn't look for contention
+   while the ULA couldn't be delaying anything */
+extern int z80_uncontended;
+
+/* That copy has to stop this long before the ULA could next delay an
+   access. No instruction takes longer, so any started earlier has made
+   all its accesses by then */
+#define Z80_UNCONTENDED_LEAD 23
+
 void z80_enable_interrupts( void );
 
 extern processor z80;
@@ -627,7 +627,13 @@ sub opcode_EXX (@) {
 EXX
 }
 
-sub opcode_HALT (@) { print "      z80.halted=1;\n      PC--;\n"; }
+sub opcode_HALT (@) {
+    print << "HALT";
+      PC--;
+      if( z80.halted ) HALT_FAST_FORWARD();
+      z80.halted=1;
+HALT
+}
 
 sub opcode_IM (@) {
 
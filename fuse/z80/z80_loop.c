@@ -0,0 +1,261 @@
+/* z80_loop.c: The Z80 core's main loop
+   Copyright (c) 1999-2005 Philip Kendall, Witold Filipczyk
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+   Author contact information:
+
+   E-mail: philip-fuse@shadowmagic.org.uk
+
+*/
+
+/* Not compiled on its own, but included by z80_ops.c once for each copy
+   of the loop it wants, in the same way as z80_ddfd.c is included for
+   both IX and IY. Z80_LOOP is the name of the function to define, and
+   Z80_LOOP_CHECKS is non-zero if the copy should make the per-opcode
+   checks; a copy without them must only be run while none of them could
+   do anything.
+
+   Z80_LOOP_UNCONTENDED is non-zero for the copy which is run outside the
+   contention window, and Z80_LOOP_RESUME for the one which finishes an
+   instruction that copy had to leave part done */
+
+static void
+Z80_LOOP( void )
+{
+#ifdef HAVE_ENOUGH_MEMORY
+  libspectrum_byte opcode = 0x00;
+#endif
+
+#if Z80_LOOP_CHECKS
+
+  int even_m1 =
+    machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_EVEN_M1;
+
+#ifdef __GNUC__
+
+#undef SETUP_CHECK
+#define SETUP_CHECK( label, condition ) \
+  if( condition ) { cgoto[ next ] = &&label; next = pos_##label + 1; } \
+  check++;
+
+#undef SETUP_NEXT
+#define SETUP_NEXT( label ) \
+  if( next != check ) { cgoto[ next ] = &&label; } \
+  next = check;
+
+  void *cgoto[ numchecks ]; size_t next = 0; size_t check = 0;
+
+#include "z80_checks.h"
+
+#endif				/* #ifdef __GNUC__ */
+
+#endif				/* #if Z80_LOOP_CHECKS */
+
+#if Z80_LOOP_RESUME
+  if( opcode_pending >= 0 ) {
+    opcode = opcode_pending; opcode_pending = -1;
+    goto end_opcode;
+  }
+#endif				/* #if Z80_LOOP_RESUME */
+
+  while( tstates < event_next_event ) {
+
+#if Z80_LOOP_CHECKS
+
+    /* Profiler */
+    CHECK( profile, profile_active )
+
+    profile_map( PC );
+
+    END_CHECK
+
+    /* If we're due an end of frame from RZX playback, generate one */
+    CHECK( rzx, rzx_playback )
+
+    if( R + rzx_instructions_offset >= rzx_instruction_count ) {
+      event_add( tstates, spectrum_frame_event );
+      break;		/* And break out of the execution loop to let
+			   the interrupt happen */
+    }
+
+    END_CHECK
+
+    /* Check if the debugger should become active at this point */
+    CHECK( debugger, debugger_mode != DEBUGGER_MODE_INACTIVE )
+
+    if( debugger_check( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, PC ) )
+      debugger_trap();
+
+    END_CHECK
+
+    CHECK( beta, beta_available )
+
+#define NOT_128_TYPE_OR_IS_48_TYPE ( !( machine_current->capabilities & \
+            LIBSPECTRUM_MACHINE_CAPABILITY_128_MEMORY ) || \
+            machine_current->ram.current_rom )
+
+    if( beta_active ) {
+      if( NOT_128_TYPE_OR_IS_48_TYPE && PC >= 16384 ) {
+	beta_unpage();
+      }
+    } else if( ( PC & beta_pc_mask ) == beta_pc_value &&
+               NOT_128_TYPE_OR_IS_48_TYPE ) {
+      beta_page();
+    }
+
+#undef NOT_128_TYPE_OR_IS_48_TYPE
+
+    END_CHECK
+
+    CHECK( plusd, plusd_available )
+
+    if( PC == 0x0008 || PC == 0x003a || PC == 0x0066 || PC == 0x028e ) {
+      plusd_page();
+    }
+
+    END_CHECK
+
+    CHECK( disciple, disciple_available )
+
+    if( PC == 0x0001 || PC == 0x0008 || PC == 0x0066 || PC == 0x028e ) {
+      disciple_page();
+    }
+
+    END_CHECK
+
+    CHECK( if1p, if1_available )
+
+    if( PC == 0x0008 || PC == 0x1708 ) {
+      if1_page();
+    }
+
+    END_CHECK
+
+    CHECK( divide_early, settings_current.divide_enabled )
+
+    if( ( PC & 0xff00 ) == 0x3d00 ) {
+      divide_set_automap( 1 );
+    }
+
+    END_CHECK
+
+    CHECK( spectranet_page, spectranet_available && !settings_current.spectranet_disable )
+
+    if( PC == 0x0008 || ((PC & 0xfff8) == 0x3ff8) )
+      spectranet_page( 0 );
+
+    if( PC == spectranet_programmable_trap &&
+      spectranet_programmable_trap_active )
+      event_add( 0, z80_nmi_event );
+
+    END_CHECK
+
+  opcode_delay:
+
+#endif				/* #if Z80_LOOP_CHECKS */
+
+    contend_read( PC, 4 );
+
+#if Z80_LOOP_CHECKS
+
+    /* Check to see if M1 cycles happen on even tstates */
+    CHECK( evenm1, even_m1 )
+
+    if( tstates & 1 ) tstates++;
+
+    END_CHECK
+
+  run_opcode:
+
+#endif				/* #if Z80_LOOP_CHECKS */
+
+    /* Do the instruction fetch; readbyte_internal used here to avoid
+       triggering read breakpoints */
+    opcode = readbyte_internal( PC );
+
+#if Z80_LOOP_CHECKS
+
+    CHECK( if1u, if1_available )
+
+    if( PC == 0x0700 ) {
+      if1_unpage();
+    }
+
+    END_CHECK
+
+    CHECK( divide_late, settings_current.divide_enabled )
+
+    if( ( PC & 0xfff8 ) == 0x1ff8 ) {
+      divide_set_automap( 0 );
+    } else if( (PC == 0x0000) || (PC == 0x0008) || (PC == 0x0038)
+      || (PC == 0x0066) || (PC == 0x04c6) || (PC == 0x0562) ) {
+      divide_set_automap( 1 );
+    }
+
+    END_CHECK
+
+    CHECK( opus, opus_available )
+
+    if( opus_active ) {
+      if( PC == 0x1748 ) {
+        opus_unpage();
+      }
+    } else if( PC == 0x0008 || PC == 0x0048 || PC == 0x1708 ) {
+      opus_page();
+    }
+
+    END_CHECK
+
+    CHECK( spectranet_unpage, spectranet_available )
+
+    if( PC == 0x007c )
+      spectranet_unpage();
+
+    END_CHECK
+
+#endif				/* #if Z80_LOOP_CHECKS */
+
+#if Z80_LOOP_UNCONTENDED
+
+    goto run_opcode;
+
+    /* A DD or FD prefix followed by an opcode which doesn't use IX or IY
+       comes back here with that opcode fetched, without going round the
+       loop, so a run of them could take this copy into the contention
+       window. The opcode was fetched in time, but what follows it might
+       not be */
+  end_opcode:
+    if( tstates >= event_next_event ) {
+      opcode_pending = opcode;
+      return;
+    }
+
+  run_opcode:
+
+#else				/* #if Z80_LOOP_UNCONTENDED */
+
+  end_opcode:
+
+#endif				/* #if Z80_LOOP_UNCONTENDED */
+
+    PC++; R++;
+    switch(opcode) {
+#include "opcodes_base.c"
+    }
+
+  }
+
+}
@@ -104,17 +104,17 @@
 #ifndef CORETEST
 
 #define contend_read(address,time) \
-  if( memory_map_read[ (address) >> MEMORY_PAGE_SIZE_LOGARITHM ].contended ) \
+  if( memory_hot_read_contended( address ) ) \
     tstates += ula_contention[ tstates ]; \
   tstates += (time);
 
 #define contend_read_no_mreq(address,time) \
-  if( memory_map_read[ (address) >> MEMORY_PAGE_SIZE_LOGARITHM ].contended ) \
+  if( memory_hot_read_contended( address ) ) \
     tstates += ula_contention_no_mreq[ tstates ]; \
   tstates += (time);
 
 #define contend_write_no_mreq(address,time) \
-  if( memory_map_write[ (address) >> MEMORY_PAGE_SIZE_LOGARITHM ].contended ) \
+  if( memory_hot_write_contended( address ) ) \
     tstates += ula_contention_no_mreq[ tstates ]; \
   tstates += (time);
 
@@ -103,185 +103,216 @@ enum {
 static libspectrum_byte opcode = 0x00;
 #endif
 
-/* Execute Z80 opcodes until the next event */
-void
-z80_do_opcodes( void )
+/* A halted Z80 just keeps fetching the HALT every four tstates until
+   something interrupts it. Once it has done so twice in a row, any
+   paging the checks above might do for this PC has been done, so if
+   nothing needs to see each fetch as it happens, run all of them up to
+   the next event in one go */
+#ifndef CORETEST
+
+#define HALT_FAST_FORWARD() \
+  if( !profile_active && !rzx_playback && \
+      debugger_mode == DEBUGGER_MODE_INACTIVE ) \
+    halt_fast_forward()
+
+static inline void
+halt_fast_forward( void )
 {
-#ifdef HAVE_ENOUGH_MEMORY
-  libspectrum_byte opcode = 0x00;
-#endif
-
   int even_m1 =
-    machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_EVEN_M1; 
-
-#ifdef __GNUC__
-
-#undef SETUP_CHECK
-#define SETUP_CHECK( label, condition ) \
-  if( condition ) { cgoto[ next ] = &&label; next = pos_##label + 1; } \
-  check++;
-
-#undef SETUP_NEXT
-#define SETUP_NEXT( label ) \
-  if( next != check ) { cgoto[ next ] = &&label; } \
-  next = check;
-
-  void *cgoto[ numchecks ]; size_t next = 0; size_t check = 0;
-
-#include "z80_checks.h"
-
-#endif				/* #ifdef __GNUC__ */
-
-  while( tstates < event_next_event ) {
-
-    /* Profiler */
-    CHECK( profile, profile_active )
-
-    profile_map( PC );
-
-    END_CHECK
-
-    /* If we're due an end of frame from RZX playback, generate one */
-    CHECK( rzx, rzx_playback )
-
-    if( R + rzx_instructions_offset >= rzx_instruction_count ) {
-      event_add( tstates, spectrum_frame_event );
-      break;		/* And break out of the execution loop to let
-			   the interrupt happen */
-    }
-
-    END_CHECK
-
-    /* Check if the debugger should become active at this point */
-    CHECK( debugger, debugger_mode != DEBUGGER_MODE_INACTIVE )
-
-    if( debugger_check( DEBUGGER_BREAKPOINT_TYPE_EXECUTE, PC ) )
-      debugger_trap();
+    machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_EVEN_M1;
+  libspectrum_dword halts;
 
-    END_CHECK
+  if( tstates >= event_next_event ) return;
 
-    CHECK( beta, beta_available )
+  if( memory_hot_read_contended( PC ) ||
+      even_m1 ) {
 
-#define NOT_128_TYPE_OR_IS_48_TYPE ( !( machine_current->capabilities & \
-            LIBSPECTRUM_MACHINE_CAPABILITY_128_MEMORY ) || \
-            machine_current->ram.current_rom )
+    /* Each fetch depends on where the previous one left the beam */
+    do {
+      contend_read( PC, 4 );
+      if( even_m1 && ( tstates & 1 ) ) tstates++;
+      R++;
+    } while( tstates < event_next_event );
 
-    if( beta_active ) {
-      if( NOT_128_TYPE_OR_IS_48_TYPE && PC >= 16384 ) {
-	beta_unpage();
-      }
-    } else if( ( PC & beta_pc_mask ) == beta_pc_value &&
-               NOT_128_TYPE_OR_IS_48_TYPE ) {
-      beta_page();
-    }
+  } else {
 
-    END_CHECK
+    halts = ( event_next_event - tstates + 3 ) / 4;
+    tstates += 4 * halts;
+    R += halts;
 
-    CHECK( plusd, plusd_available )
-
-    if( PC == 0x0008 || PC == 0x003a || PC == 0x0066 || PC == 0x028e ) {
-      plusd_page();
-    }
-
-    END_CHECK
-
-    CHECK( disciple, disciple_available )
-
-    if( PC == 0x0001 || PC == 0x0008 || PC == 0x0066 || PC == 0x028e ) {
-      disciple_page();
-    }
-
-    END_CHECK
+  }
+}
 
-    CHECK( if1p, if1_available )
+#else				/* #ifndef CORETEST */
 
-    if( PC == 0x0008 || PC == 0x1708 ) {
-      if1_page();
-    }
+#define HALT_FAST_FORWARD()
 
-    END_CHECK
+#endif				/* #ifndef CORETEST */
 
-    CHECK( divide_early, settings_current.divide_enabled )
-    
-    if( ( PC & 0xff00 ) == 0x3d00 ) {
-      divide_set_automap( 1 );
-    }
-    
-    END_CHECK
+/* The copy of the core outside the contention window and the copy which
+   finishes what it had to leave part done need each other, and neither is
+   any use to the core tester */
+#if defined( HAVE_ENOUGH_MEMORY ) && !defined( CORETEST )
+#define Z80_UNCONTENDED_COPY 1
+#else
+#define Z80_UNCONTENDED_COPY 0
+#endif
 
-    CHECK( spectranet_page, spectranet_available && !settings_current.spectranet_disable )
+int z80_uncontended = 1;
 
-    if( PC == 0x0008 || ((PC & 0xfff8) == 0x3ff8) )
-      spectranet_page( 0 );
+#if Z80_UNCONTENDED_COPY
 
-    if( PC == spectranet_programmable_trap &&
-      spectranet_programmable_trap_active )
-      event_add( 0, z80_nmi_event );
+/* An opcode the uncontended copy fetched after a DD or FD prefix but left
+   for the contended one to run, or -1 */
+static int opcode_pending = -1;
 
-    END_CHECK
+#endif			/* #if Z80_UNCONTENDED_COPY */
 
-  opcode_delay:
+/* The copy of the loop which makes all the checks above */
+#define Z80_LOOP z80_do_opcodes_checked
+#define Z80_LOOP_CHECKS 1
+#define Z80_LOOP_UNCONTENDED 0
+#define Z80_LOOP_RESUME 0
+#include "z80_loop.c"
+#undef Z80_LOOP_RESUME
+#undef Z80_LOOP_UNCONTENDED
+#undef Z80_LOOP_CHECKS
+#undef Z80_LOOP
 
-    contend_read( PC, 4 );
+/* And one which makes none of them, for when none could do anything: no
+   peripheral with a paging trap or a memory hook is attached, and nothing
+   needs to see each opcode. That's the plain 48K and 128K machines, and
+   the +2A and +3. In that copy, readbyte() and writebyte() don't need to
+   look for the debugger or for peripherals either */
+#if Z80_UNCONTENDED_COPY
 
-    /* Check to see if M1 cycles happen on even tstates */
-    CHECK( evenm1, even_m1 )
+static inline libspectrum_byte
+readbyte_plain( libspectrum_word address )
+{
+  memory_hot_page *mapping =
+    &memory_map_hot_read[ address >> MEMORY_PAGE_SIZE_LOGARITHM ];
 
-    if( tstates & 1 ) tstates++;
+  if( mapping->contended ) tstates += ula_contention[ tstates ];
+  tstates += 3;
 
-    END_CHECK
+  return mapping->page[ address & MEMORY_PAGE_SIZE_MASK ];
+}
 
-  run_opcode:
-    /* Do the instruction fetch; readbyte_internal used here to avoid
-       triggering read breakpoints */
-    opcode = readbyte_internal( PC );
+static inline void
+writebyte_plain( libspectrum_word address, libspectrum_byte b )
+{
+  if( memory_hot_write_contended( address ) )
+    tstates += ula_contention[ tstates ];
+  tstates += 3;
 
-    CHECK( if1u, if1_available )
+  writebyte_unhooked( address, b );
+}
 
-    if( PC == 0x0700 ) {
-      if1_unpage();
-    }
+#define readbyte( address ) readbyte_plain( address )
+#define writebyte( address, b ) writebyte_plain( address, b )
 
-    END_CHECK
+#endif			/* #if Z80_UNCONTENDED_COPY */
 
-    CHECK( divide_late, settings_current.divide_enabled )
+#define Z80_LOOP z80_do_opcodes_plain
+#define Z80_LOOP_CHECKS 0
+#define Z80_LOOP_UNCONTENDED 0
+#define Z80_LOOP_RESUME Z80_UNCONTENDED_COPY
+#include "z80_loop.c"
+#undef Z80_LOOP_RESUME
+#undef Z80_LOOP_UNCONTENDED
+#undef Z80_LOOP_CHECKS
+#undef Z80_LOOP
 
-    if( ( PC & 0xfff8 ) == 0x1ff8 ) {
-      divide_set_automap( 0 );
-    } else if( (PC == 0x0000) || (PC == 0x0008) || (PC == 0x0038)
-      || (PC == 0x0066) || (PC == 0x04c6) || (PC == 0x0562) ) {
-      divide_set_automap( 1 );
-    }
-    
-    END_CHECK
+#undef readbyte
+#undef writebyte
 
-    CHECK( opus, opus_available )
+/* And the same again for while the ULA couldn't be delaying anything,
+   with the contention left out: accesses just take their time */
+#if Z80_UNCONTENDED_COPY
 
-    if( opus_active ) {
-      if( PC == 0x1748 ) {
-        opus_unpage();
-      }
-    } else if( PC == 0x0008 || PC == 0x0048 || PC == 0x1708 ) {
-      opus_page();
-    }
+static inline libspectrum_byte
+readbyte_uncontended( libspectrum_word address )
+{
+  tstates += 3;
+  return readbyte_internal( address );
+}
 
-    END_CHECK
+static inline void
+writebyte_uncontended( libspectrum_word address, libspectrum_byte b )
+{
+  tstates += 3;
+  writebyte_unhooked( address, b );
+}
 
-    CHECK( spectranet_unpage, spectranet_available )
+#define readbyte( address ) readbyte_uncontended( address )
+#define writebyte( address, b ) writebyte_uncontended( address, b )
+
+#undef contend_read
+#undef contend_read_no_mreq
+#undef contend_write_no_mreq
+
+#define contend_read( address, time ) tstates += (time);
+#define contend_read_no_mreq( address, time ) tstates += (time);
+#define contend_write_no_mreq( address, time ) tstates += (time);
+
+#define Z80_LOOP z80_do_opcodes_uncontended
+#define Z80_LOOP_CHECKS 0
+#define Z80_LOOP_UNCONTENDED 1
+#define Z80_LOOP_RESUME 0
+#include "z80_loop.c"
+#undef Z80_LOOP_RESUME
+#undef Z80_LOOP_UNCONTENDED
+#undef Z80_LOOP_CHECKS
+#undef Z80_LOOP
+
+/* Nothing after this should be without contention */
+#undef contend_read
+#undef contend_read_no_mreq
+#undef contend_write_no_mreq
+
+#undef readbyte
+#undef writebyte
+
+/* Whether the uncontended copy can run until the next event: either the
+   window has passed, or it is far enough away */
+#define UNCONTENDED_UNTIL_NEXT_EVENT \
+  ( tstates >= ula_contention_end || \
+    ( ula_contention_start >= Z80_UNCONTENDED_LEAD && \
+      event_next_event <= ula_contention_start - Z80_UNCONTENDED_LEAD ) )
+
+#endif			/* #if Z80_UNCONTENDED_COPY */
+
+#ifndef CORETEST
+#define MEMORY_HOOKS_ACTIVE memory_hooks
+#else				/* #ifndef CORETEST */
+#define MEMORY_HOOKS_ACTIVE 0
+#endif				/* #ifndef CORETEST */
 
-    if( PC == 0x007c )
-      spectranet_unpage();
+/* Execute Z80 opcodes until the next event */
+void
+z80_do_opcodes( void )
+{
+  int even_m1 =
+    machine_current->capabilities & LIBSPECTRUM_MACHINE_CAPABILITY_EVEN_M1;
 
-    END_CHECK
+#undef SETUP_CHECK
+#define SETUP_CHECK( label, condition ) ( condition ) ||
 
-  end_opcode:
-    PC++; R++;
-    switch(opcode) {
-#include "opcodes_base.c"
-    }
+#undef SETUP_NEXT
+#define SETUP_NEXT( label )
 
+  if(
+#include "z80_checks.h"
+      MEMORY_HOOKS_ACTIVE ) {
+    z80_do_opcodes_checked();
+#if Z80_UNCONTENDED_COPY
+  } else if( z80_uncontended && UNCONTENDED_UNTIL_NEXT_EVENT ) {
+    z80_do_opcodes_uncontended();
+    if( opcode_pending >= 0 ) z80_do_opcodes_plain();
+#endif			/* #if Z80_UNCONTENDED_COPY */
+  } else {
+    z80_do_opcodes_plain();
   }
-
 }
 
 #ifndef HAVE_ENOUGH_MEMORY
@@ -1263,6 +1263,29 @@ libspectrum_tape_position( int *n, libspectrum_tape *tape )
   return LIBSPECTRUM_ERROR_NONE;
 }
 
+/* Raw copies of the current block state, used for in-process
+   savestates. The state holds pointers into the block list, so it can
+   only be restored to the same tape it was taken from */
+size_t
+libspectrum_tape_position_state_length( void )
+{
+  return sizeof( libspectrum_tape_block_state );
+}
+
+void
+libspectrum_tape_position_state_get( libspectrum_tape *tape,
+                                     libspectrum_byte *buffer )
+{
+  memcpy( buffer, &tape->state, sizeof( tape->state ) );
+}
+
+void
+libspectrum_tape_position_state_set( libspectrum_tape *tape,
+                                     const libspectrum_byte *buffer )
+{
+  memcpy( &tape->state, buffer, sizeof( tape->state ) );
+}
+
 /* Select the nth block on the tape */
 libspectrum_error
 libspectrum_tape_nth_block( libspectrum_tape *tape, int n )
@@ -1,9 +1,20 @@
 // Compatibility display funcions
 
+#include <assert.h>
+
 #include <libretro.h>
 #include <externs.h>
 #include <machine.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+dirty_rect_t dirty_rects[MAX_DIRTY_RECTS];
+int dirty_rect_count;
+
 static const uint16_t palette[16] = {
    0x0000, 0x0018, 0xc000, 0xc018,
    0x0600, 0x0618, 0xc600, 0xc618,
@@ -21,6 +32,107 @@ static const uint16_t greys[16] = {
 };
 */
 
+// Eight pixels at a time: expand8 turns the bits of a byte, most
+// significant first, into ink and paper pixels, which store writes out
+// as they are and store_doubled writes out with each pixel twice for the
+// Timex machines' 640 pixel wide screen. The SIMD versions do the whole
+// byte with a compare and a select instead of one branch per pixel.
+
+#if defined(__SSE2__)
+
+typedef __m128i pixels_t;
+
+static inline pixels_t expand8(unsigned data, uint16_t ink, uint16_t paper)
+{
+   const __m128i bits = _mm_setr_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+   __m128i mask = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(data), bits), bits);
+   return _mm_or_si128(_mm_and_si128(mask, _mm_set1_epi16(ink)), _mm_andnot_si128(mask, _mm_set1_epi16(paper)));
+}
+
+static inline void store(uint16_t* dest, pixels_t pixels)
+{
+   _mm_storeu_si128((__m128i*)dest, pixels);
+}
+
+static inline void store_doubled(uint16_t* dest, pixels_t pixels)
+{
+   _mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi16(pixels, pixels));
+   _mm_storeu_si128((__m128i*)(dest + 8), _mm_unpackhi_epi16(pixels, pixels));
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+typedef uint16x8_t pixels_t;
+
+static inline pixels_t expand8(unsigned data, uint16_t ink, uint16_t paper)
+{
+   static const uint16_t bits[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+   uint16x8_t mask = vtstq_u16(vdupq_n_u16(data), vld1q_u16(bits));
+   return vbslq_u16(mask, vdupq_n_u16(ink), vdupq_n_u16(paper));
+}
+
+static inline void store(uint16_t* dest, pixels_t pixels)
+{
+   vst1q_u16(dest, pixels);
+}
+
+static inline void store_doubled(uint16_t* dest, pixels_t pixels)
+{
+   uint16x8x2_t doubled = vzipq_u16(pixels, pixels);
+   vst1q_u16(dest, doubled.val[0]);
+   vst1q_u16(dest + 8, doubled.val[1]);
+}
+
+#else
+
+typedef struct
+{
+   uint16_t pixel[8];
+}
+pixels_t;
+
+static inline pixels_t expand8(unsigned data, uint16_t ink, uint16_t paper)
+{
+   pixels_t pixels;
+
+   pixels.pixel[0] = data & 0x80 ? ink : paper;
+   pixels.pixel[1] = data & 0x40 ? ink : paper;
+   pixels.pixel[2] = data & 0x20 ? ink : paper;
+   pixels.pixel[3] = data & 0x10 ? ink : paper;
+   pixels.pixel[4] = data & 0x08 ? ink : paper;
+   pixels.pixel[5] = data & 0x04 ? ink : paper;
+   pixels.pixel[6] = data & 0x02 ? ink : paper;
+   pixels.pixel[7] = data & 0x01 ? ink : paper;
+
+   return pixels;
+}
+
+static inline void store(uint16_t* dest, pixels_t pixels)
+{
+   dest[0] = pixels.pixel[0];
+   dest[1] = pixels.pixel[1];
+   dest[2] = pixels.pixel[2];
+   dest[3] = pixels.pixel[3];
+   dest[4] = pixels.pixel[4];
+   dest[5] = pixels.pixel[5];
+   dest[6] = pixels.pixel[6];
+   dest[7] = pixels.pixel[7];
+}
+
+static inline void store_doubled(uint16_t* dest, pixels_t pixels)
+{
+   dest[ 0] = dest[ 1] = pixels.pixel[0];
+   dest[ 2] = dest[ 3] = pixels.pixel[1];
+   dest[ 4] = dest[ 5] = pixels.pixel[2];
+   dest[ 6] = dest[ 7] = pixels.pixel[3];
+   dest[ 8] = dest[ 9] = pixels.pixel[4];
+   dest[10] = dest[11] = pixels.pixel[5];
+   dest[12] = dest[13] = pixels.pixel[6];
+   dest[14] = dest[15] = pixels.pixel[7];
+}
+
+#endif
+
 int uidisplay_init(int width, int height)
 {
    log_cb(RETRO_LOG_DEBUG, "%s(%d, %d)\n", __FUNCTION__, width, height);
@@ -47,10 +159,26 @@ int uidisplay_init(int width, int height)
 
 void uidisplay_area(int x, int y, int w, int h)
 {
-   (void)x;
-   (void)y;
-   (void)w;
-   (void)h;
+   // Skipped frames are passed on as dupes, so mustn't change anything
+   assert(!display_suspended);
+
+   if (dirty_rect_count < 0)
+   {
+      return;
+   }
+   
+   if (dirty_rect_count == MAX_DIRTY_RECTS)
+   {
+      // Too many to keep track of, just say everything has changed
+      dirty_rect_count = -1;
+      return;
+   }
+   
+   dirty_rects[dirty_rect_count].x = x;
+   dirty_rects[dirty_rect_count].y = y;
+   dirty_rects[dirty_rect_count].w = w;
+   dirty_rects[dirty_rect_count].h = h;
+   dirty_rect_count++;
 }
 
 void uidisplay_frame_end(void)
@@ -94,9 +222,7 @@ void uidisplay_putpixel(int x, int y, int color)
 
 void uidisplay_plot8(int x, int y, libspectrum_byte data, libspectrum_byte ink, libspectrum_byte paper)
 {
-   // TODO: SSE versions maybe?
-   uint16_t palette_ink = palette[ink];
-   uint16_t palette_paper = palette[paper];
+   pixels_t pixels = expand8(data, palette[ink], palette[paper]);
    
    x <<= 3;
 
@@ -105,126 +231,58 @@ void uidisplay_plot8(int x, int y, libspectrum_byte data, libspectrum_byte ink,
       x <<= 1; y <<= 1;
       uint16_t* image_buffer_pos = image_buffer + (y * hard_width + x);
       
-      uint16_t data_80 = data & 0x80 ? palette_ink : palette_paper;
-      uint16_t data_40 = data & 0x40 ? palette_ink : palette_paper;
-      uint16_t data_20 = data & 0x20 ? palette_ink : palette_paper;
-      uint16_t data_10 = data & 0x10 ? palette_ink : palette_paper;
-      uint16_t data_08 = data & 0x08 ? palette_ink : palette_paper;
-      uint16_t data_04 = data & 0x04 ? palette_ink : palette_paper;
-      uint16_t data_02 = data & 0x02 ? palette_ink : palette_paper;
-      uint16_t data_01 = data & 0x01 ? palette_ink : palette_paper;
-    
-      *image_buffer_pos++ = data_80;
-      *image_buffer_pos++ = data_80;
-      *image_buffer_pos++ = data_40;
-      *image_buffer_pos++ = data_40;
-      *image_buffer_pos++ = data_20;
-      *image_buffer_pos++ = data_20;
-      *image_buffer_pos++ = data_10;
-      *image_buffer_pos++ = data_10;
-      *image_buffer_pos++ = data_08;
-      *image_buffer_pos++ = data_08;
-      *image_buffer_pos++ = data_04;
-      *image_buffer_pos++ = data_04;
-      *image_buffer_pos++ = data_02;
-      *image_buffer_pos++ = data_02;
-      *image_buffer_pos++ = data_01;
-      *image_buffer_pos   = data_01;
-    
-      image_buffer_pos += hard_width - 15;
-
-      *image_buffer_pos++ = data_80;
-      *image_buffer_pos++ = data_80;
-      *image_buffer_pos++ = data_40;
-      *image_buffer_pos++ = data_40;
-      *image_buffer_pos++ = data_20;
-      *image_buffer_pos++ = data_20;
-      *image_buffer_pos++ = data_10;
-      *image_buffer_pos++ = data_10;
-      *image_buffer_pos++ = data_08;
-      *image_buffer_pos++ = data_08;
-      *image_buffer_pos++ = data_04;
-      *image_buffer_pos++ = data_04;
-      *image_buffer_pos++ = data_02;
-      *image_buffer_pos++ = data_02;
-      *image_buffer_pos++ = data_01;
-      *image_buffer_pos   = data_01;
+      store_doubled(image_buffer_pos, pixels);
+      store_doubled(image_buffer_pos + hard_width, pixels);
+   }
+   else
+   {
+      store(image_buffer + (y * hard_width + x), pixels);
+   }
+}
+
+void uidisplay_plot8_run(int x, int y, int count, const libspectrum_byte* data, const libspectrum_byte* ink, const libspectrum_byte* paper)
+{
+   int i;
+   
+   x <<= 3;
+
+   if (machine_current->timex)
+   {
+      x <<= 1; y <<= 1;
+      uint16_t* image_buffer_pos = image_buffer + (y * hard_width + x);
+      
+      for (i = 0; i < count; i++, image_buffer_pos += 16)
+      {
+         pixels_t pixels = expand8(data[i], palette[ink[i]], palette[paper[i]]);
+         store_doubled(image_buffer_pos, pixels);
+         store_doubled(image_buffer_pos + hard_width, pixels);
+      }
    }
    else
    {
       uint16_t* image_buffer_pos = image_buffer + (y * hard_width + x);
       
-      *image_buffer_pos++ = data & 0x80 ? palette_ink : palette_paper;
-      *image_buffer_pos++ = data & 0x40 ? palette_ink : palette_paper;
-      *image_buffer_pos++ = data & 0x20 ? palette_ink : palette_paper;
-      *image_buffer_pos++ = data & 0x10 ? palette_ink : palette_paper;
-      *image_buffer_pos++ = data & 0x08 ? palette_ink : palette_paper;
-      *image_buffer_pos++ = data & 0x04 ? palette_ink : palette_paper;
-      *image_buffer_pos++ = data & 0x02 ? palette_ink : palette_paper;
-      *image_buffer_pos   = data & 0x01 ? palette_ink : palette_paper;
+      for (i = 0; i < count; i++, image_buffer_pos += 8)
+         store(image_buffer_pos, expand8(data[i], palette[ink[i]], palette[paper[i]]));
    }
 }
 
 void uidisplay_plot16(int x, int y, libspectrum_word data, libspectrum_byte ink, libspectrum_byte paper)
 {
-   // TODO: SSE versions maybe?
    uint16_t palette_ink = palette[ink];
    uint16_t palette_paper = palette[paper];
+   pixels_t left = expand8(data >> 8, palette_ink, palette_paper);
+   pixels_t right = expand8(data & 0xff, palette_ink, palette_paper);
    x <<= 4; y <<= 1;
    uint16_t* image_buffer_pos = image_buffer + (y * hard_width + x);
    
-   uint16_t data_8000 = data & 0x8000 ? palette_ink : palette_paper;
-   uint16_t data_4000 = data & 0x4000 ? palette_ink : palette_paper;
-   uint16_t data_2000 = data & 0x2000 ? palette_ink : palette_paper;
-   uint16_t data_1000 = data & 0x1000 ? palette_ink : palette_paper;
-   uint16_t data_0800 = data & 0x0800 ? palette_ink : palette_paper;
-   uint16_t data_0400 = data & 0x0400 ? palette_ink : palette_paper;
-   uint16_t data_0200 = data & 0x0200 ? palette_ink : palette_paper;
-   uint16_t data_0100 = data & 0x0100 ? palette_ink : palette_paper;
-   uint16_t data_0080 = data & 0x0080 ? palette_ink : palette_paper;
-   uint16_t data_0040 = data & 0x0040 ? palette_ink : palette_paper;
-   uint16_t data_0020 = data & 0x0020 ? palette_ink : palette_paper;
-   uint16_t data_0010 = data & 0x0010 ? palette_ink : palette_paper;
-   uint16_t data_0008 = data & 0x0008 ? palette_ink : palette_paper;
-   uint16_t data_0004 = data & 0x0004 ? palette_ink : palette_paper;
-   uint16_t data_0002 = data & 0x0002 ? palette_ink : palette_paper;
-   uint16_t data_0001 = data & 0x0001 ? palette_ink : palette_paper;
-
-   *image_buffer_pos++ = data_8000;
-   *image_buffer_pos++ = data_4000;
-   *image_buffer_pos++ = data_2000;
-   *image_buffer_pos++ = data_1000;
-   *image_buffer_pos++ = data_0800;
-   *image_buffer_pos++ = data_0400;
-   *image_buffer_pos++ = data_0200;
-   *image_buffer_pos++ = data_0100;
-   *image_buffer_pos++ = data_0080;
-   *image_buffer_pos++ = data_0040;
-   *image_buffer_pos++ = data_0020;
-   *image_buffer_pos++ = data_0010;
-   *image_buffer_pos++ = data_0008;
-   *image_buffer_pos++ = data_0004;
-   *image_buffer_pos++ = data_0002;
-   *image_buffer_pos   = data_0001;
+   store(image_buffer_pos, left);
+   store(image_buffer_pos + 8, right);
   
-   image_buffer_pos += hard_width - 15;
-
-   *image_buffer_pos++ = data_8000;
-   *image_buffer_pos++ = data_4000;
-   *image_buffer_pos++ = data_2000;
-   *image_buffer_pos++ = data_1000;
-   *image_buffer_pos++ = data_0800;
-   *image_buffer_pos++ = data_0400;
-   *image_buffer_pos++ = data_0200;
-   *image_buffer_pos++ = data_0100;
-   *image_buffer_pos++ = data_0080;
-   *image_buffer_pos++ = data_0040;
-   *image_buffer_pos++ = data_0020;
-   *image_buffer_pos++ = data_0010;
-   *image_buffer_pos++ = data_0008;
-   *image_buffer_pos++ = data_0004;
-   *image_buffer_pos++ = data_0002;
-   *image_buffer_pos   = data_0001;
+   image_buffer_pos += hard_width;
+
+   store(image_buffer_pos, left);
+   store(image_buffer_pos + 8, right);
 }
 
 void uidisplay_frame_save( void )
@@ -6,7 +6,7 @@
 int sound_lowlevel_init(const char *device, int *freqptr, int *stereoptr)
 {
    (void)device;
-   *freqptr = 44100;
+   (void)freqptr; // Whatever the fuse_sample_rate core option asked for
    *stereoptr = 1;
    return 0;
 }
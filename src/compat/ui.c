@@ -149,6 +149,10 @@ int ui_event(void)
          {
             for (id = 0; id < sizeof(map) / sizeof(map[0]); id++)
             {
+               // The rewind button is the frontend's, not the Spectrum's
+               if (port == 0 && rewind_device == RETRO_DEVICE_JOYPAD && map[id] == rewind_id)
+                  continue;
+
                is_down = input_state_cb(port, RETRO_DEVICE_JOYPAD, 0, map[id]);
                
                bool keyboard_event;
@@ -215,6 +219,10 @@ int ui_event(void)
             for (id = 0; keysyms_map[id].ui; id++)
             {
                unsigned ui = keysyms_map[id].ui;
+
+               if (rewind_device == RETRO_DEVICE_KEYBOARD && ui == rewind_id)
+                  continue;
+
                is_down = input_state_cb(port, RETRO_DEVICE_KEYBOARD, 0, ui);
                
                if (is_down)
@@ -25,14 +25,37 @@
 #define MAX_HEIGHT 480
 #define MAX_PADS   3
 
+#define MAX_DIRTY_RECTS 64
+
+typedef struct
+{
+   int x, y, w, h;
+}
+dirty_rect_t;
+
+typedef struct
+{
+   unsigned long frames;        // frames shown
+   unsigned long dupes;         // of which were passed on as duplicates
+   unsigned rects;              // dirty rectangles in the last frame shown
+   unsigned long pixels;        // pixels they cover
+   unsigned long screen_pixels; // out of this many
+   uint64_t total_pixels;       // dirty pixels over all the frames
+}
+video_stats_t;
+
 // From the core
 extern double total_time_ms;
 extern retro_environment_t env_cb;
 extern retro_log_printf_t log_cb;
 extern retro_audio_sample_batch_t audio_cb;
 extern retro_input_state_t input_state_cb;
+// What is held to rewind: a key on RETRO_DEVICE_KEYBOARD or a button on the
+// first RETRO_DEVICE_JOYPAD, or RETRO_DEVICE_NONE with rewinding off
+extern unsigned rewind_device, rewind_id;
 extern uint16_t image_buffer[MAX_WIDTH * MAX_HEIGHT];
 extern unsigned hard_width, hard_height;
+extern video_stats_t video_stats;
 extern int show_frame, some_audio;
 extern retro_log_printf_t log_cb;
 extern unsigned input_devices[MAX_PADS];
@@ -47,11 +70,18 @@ extern bool joypad_state[MAX_PADS][16];
 extern bool keyb_state[RETROK_LAST];
 extern void* snapshot_buffer;
 extern size_t snapshot_size;
+extern size_t snapshot_length;
 extern void* tape_data;
 extern size_t tape_size;
 extern int joymap[16];
 extern keysyms_map_t keysyms_map[];
 
+// From compat/display.c
+// The areas of image_buffer changed by the frames shown since the last
+// retro_run, or a count of -1 if all of it should be considered changed
+extern dirty_rect_t dirty_rects[MAX_DIRTY_RECTS];
+extern int dirty_rect_count;
+
 int update_variables(int);
 int fuse_ui_error_specific(ui_error_level, const char*);
 
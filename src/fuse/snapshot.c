@@ -37,6 +37,7 @@ int fuse_write_snapshot(const char *filename, const unsigned char *buffer, size_
    }
 
    memcpy(snapshot_buffer, buffer, length);
+   snapshot_length = length;
    return 0;
 }
 
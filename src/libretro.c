@@ -2,6 +2,8 @@
 #include <keyboverlay.h>
 
 #include <coreopt.h>
+#include <perf.h>
+#include <assert.h>
 #include <stddef.h>
 #include <string.h>
 #include <errno.h>
@@ -12,14 +14,22 @@
 #include <externs.h>
 #include <utils.h>
 #include <spectrum.h>
+#include <display.h>
+#include <state.h>
+#include <rewind.h>
+#include <rollback.h>
+#include <sound.h>
+#include <tape.h>
 #include <keyboard.h>
 #include <machines/specplus3.h>
+#include <peripherals/ay.h>
 #include <peripherals/disk/beta.h>
 #include <peripherals/disk/plusd.h>
 #include <peripherals/if1.h>
 #include <peripherals/disk/opus.h>
 #include <peripherals/disk/disciple.h>
 #include <pokefinder/pokemem.h>
+#include <z80/z80.h>
 
 static void dummy_log(enum retro_log_level level, const char *fmt, ...)
 {
@@ -30,6 +40,7 @@ static void dummy_log(enum retro_log_level level, const char *fmt, ...)
 #define UPDATE_AV_INFO  1
 #define UPDATE_GEOMETRY 2
 #define UPDATE_MACHINE  4
+#define UPDATE_SOUND    8
 #define SPECTRUMKEYS "<none>|0|1|2|3|4|5|6|7|8|9|a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z|Enter|Caps|Symbol|Space"
 
 typedef struct cheat_t cheat_t;
@@ -77,16 +88,35 @@ static const machine_t machine_list[] =
 
 static int fuse_init_called = 0;
 
+#ifdef LOG_PERFORMANCE
+struct retro_perf_callback perf_cb;
+#endif
+
+PERF_COUNTER(z80_do_opcodes);
+PERF_COUNTER(event_do_events);
+PERF_COUNTER(render_video);
+PERF_COUNTER(rewind_capture);
+
 static retro_video_refresh_t video_cb;
 static retro_input_poll_t input_poll_cb;
 
 static uint16_t image_buffer_2[MAX_WIDTH * MAX_HEIGHT];
+static int overlay_active;
+static bool can_dupe;
 static unsigned first_pixel;
 static unsigned soft_width, soft_height;
 static int hide_border;
 static int keyb_transparent;
 static const machine_t* machine;
 static double frame_time;
+static int run_ahead;
+static int rollback_ready;
+static size_t rewind_budget;
+static int fast_forward_skip;
+static int fast_forwarding;
+static int frames_skipped;
+static retro_time_t tape_turbo_budget;
+static retro_perf_get_time_usec_t get_time_usec;
 static cheat_t* active_cheats;
 
 // allow access to variables declared here
@@ -95,8 +125,11 @@ retro_environment_t env_cb;
 retro_log_printf_t log_cb = dummy_log;
 retro_audio_sample_batch_t audio_cb;
 retro_input_state_t input_state_cb;
+unsigned rewind_device = RETRO_DEVICE_NONE;
+unsigned rewind_id;
 uint16_t image_buffer[MAX_WIDTH * MAX_HEIGHT];
 unsigned hard_width, hard_height;
+video_stats_t video_stats;
 int show_frame, some_audio;
 unsigned input_devices[MAX_PADS];
 int64_t keyb_send;
@@ -110,6 +143,9 @@ bool joypad_state[MAX_PADS][16];
 bool keyb_state[RETROK_LAST];
 void*  snapshot_buffer;
 size_t snapshot_size;
+size_t snapshot_length;
+static size_t serialize_size;
+static const fuse_machine_info* serialize_machine;
 void* tape_data;
 size_t tape_size;
 int joymap[16];
@@ -270,8 +306,19 @@ static const struct retro_variable core_vars[] =
    { "fuse_load_sound", "Tape Load Sound; enabled|disabled" },
    { "fuse_speaker_type", "Speaker Type; tv speaker|beeper|unfiltered" },
    { "fuse_ay_stereo_separation", "AY Stereo Separation; none|acb|abc" },
+   { "fuse_ay_coalesce", "Drop AY Writes Which Change Nothing; enabled|disabled" },
+   { "fuse_sample_rate", "Audio Sample Rate in Hz; 44100|22050|32000|48000|96000" },
+#ifdef HAVE_THREADS
+   { "fuse_sound_thread", "Make Sound on a Separate Thread (one frame late); disabled|enabled" },
+#endif
    { "fuse_key_ovrlay_transp", "Transparent Keyboard Overlay; enabled|disabled" },
    { "fuse_key_hold_time", "Time to Release Key in ms; 500|1000|100|300" },
+   { "fuse_run_ahead", "Run-Ahead Frames; 0|1|2|3" },
+   { "fuse_rewind", "Rewind Buffer; disabled|16MB|32MB|64MB|128MB" },
+   { "fuse_rewind_control", "Hold to Rewind; Page Up|Page Down|Home|End|Insert|Delete|RetroPad L2|RetroPad R2|RetroPad L3|RetroPad R3" },
+   { "fuse_fast_forward_skip", "Frames Skipped When Fast-Forwarding; disabled|1|3|7|15" },
+   { "fuse_tape_turbo", "Tape Turbo (time per frame spent loading); disabled|4ms|8ms|12ms|16ms" },
+   { "fuse_uncontended", "Skip Contention Outside the Screen; enabled|disabled" },
    { "fuse_joypad_left",    "Joypad Left mapping; " SPECTRUMKEYS },
    { "fuse_joypad_right",   "Joypad Right mapping; " SPECTRUMKEYS },
    { "fuse_joypad_up",      "Joypad Up mapping; " SPECTRUMKEYS },
@@ -400,6 +447,35 @@ int update_variables(int force)
       settings_current.stereo_ay = utils_safe_strdup(option == 1 ? "ACB" : option == 2 ? "ABC" : "None");
    }
 
+   sound_ay_coalesce = coreopt(env_cb, core_vars, "fuse_ay_coalesce", NULL) != 1;
+   z80_uncontended = coreopt(env_cb, core_vars, "fuse_uncontended", NULL) != 1;
+
+   {
+      // Blip_Buffer resamples straight to this rate, so the frontend gets
+      // exactly what it asked for
+      const char* value;
+      int option = coreopt(env_cb, core_vars, "fuse_sample_rate", &value);
+      int freq = option >= 0 ? strtol(value, NULL, 10) : 44100;
+
+      if (freq != settings_current.sound_freq)
+      {
+         settings_current.sound_freq = freq;
+         flags |= UPDATE_AV_INFO | UPDATE_SOUND;
+      }
+   }
+
+#ifdef HAVE_THREADS
+   {
+      int option = coreopt(env_cb, core_vars, "fuse_sound_thread", NULL) == 1;
+
+      if (option != sound_threaded)
+      {
+         sound_threaded = option;
+         flags |= UPDATE_SOUND;
+      }
+   }
+#endif
+
    keyb_transparent = coreopt(env_cb, core_vars, "fuse_key_ovrlay_transp", NULL) != 1;
 
    {
@@ -408,6 +484,58 @@ int update_variables(int force)
       keyb_hold_time = option >= 0 ? strtoll(value, NULL, 10) * 1000LL : 500000LL;
    }
 
+   run_ahead = coreopt(env_cb, core_vars, "fuse_run_ahead", NULL);
+   if (run_ahead < 0) run_ahead = 0;
+
+   {
+      const char* value;
+      int option = coreopt(env_cb, core_vars, "fuse_fast_forward_skip", &value);
+      fast_forward_skip = option > 0 ? strtol(value, NULL, 10) : 0;
+   }
+
+   {
+      const char* value;
+      int option = coreopt(env_cb, core_vars, "fuse_tape_turbo", &value);
+      tape_turbo_budget = option > 0 ? strtol(value, NULL, 10) * 1000 : 0;
+   }
+
+   {
+      const char* value;
+      int option = coreopt(env_cb, core_vars, "fuse_rewind", &value);
+      size_t budget = option > 0 ? strtoul(value, NULL, 10) * 1024 * 1024 : 0;
+
+      if (budget != rewind_budget)
+      {
+         rewind_init(budget);
+         rewind_budget = budget;
+      }
+   }
+
+   {
+      // ui_event() leaves out whichever is chosen, so rewinding doesn't
+      // press anything on the Spectrum
+      static const struct { unsigned device, id; } controls[] = {
+         { RETRO_DEVICE_KEYBOARD, RETROK_PAGEUP },
+         { RETRO_DEVICE_KEYBOARD, RETROK_PAGEDOWN },
+         { RETRO_DEVICE_KEYBOARD, RETROK_HOME },
+         { RETRO_DEVICE_KEYBOARD, RETROK_END },
+         { RETRO_DEVICE_KEYBOARD, RETROK_INSERT },
+         { RETRO_DEVICE_KEYBOARD, RETROK_DELETE },
+         { RETRO_DEVICE_JOYPAD,   RETRO_DEVICE_ID_JOYPAD_L2 },
+         { RETRO_DEVICE_JOYPAD,   RETRO_DEVICE_ID_JOYPAD_R2 },
+         { RETRO_DEVICE_JOYPAD,   RETRO_DEVICE_ID_JOYPAD_L3 },
+         { RETRO_DEVICE_JOYPAD,   RETRO_DEVICE_ID_JOYPAD_R3 },
+      };
+
+      int option = coreopt(env_cb, core_vars, "fuse_rewind_control", NULL);
+
+      if (option < 0)
+         option = 0;
+
+      rewind_device = rewind_budget ? controls[option].device : RETRO_DEVICE_NONE;
+      rewind_id = controls[option].id;
+   }
+
    const char* value;
    int option = coreopt(env_cb, core_vars, "fuse_joypad_up", &value );
    joymap[ RETRO_DEVICE_ID_JOYPAD_UP ] = spectrum_keys_map[option];
@@ -540,6 +668,24 @@ void retro_init(void)
       log_cb = log.log;
    }
 
+#ifdef LOG_PERFORMANCE
+   if (!env_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf_cb))
+      memset(&perf_cb, 0, sizeof(perf_cb));
+#endif
+
+   // The frontend's clock, for the tape turbo's time budget
+   {
+      struct retro_perf_callback perf;
+      get_time_usec = env_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf) ? perf.get_time_usec : NULL;
+   }
+
+   if (!env_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe))
+   {
+      can_dupe = false;
+   }
+
+   memset(&video_stats, 0, sizeof(video_stats));
+
    machine = machine_list;
    total_time_ms = 0.0;
    active_cheats = NULL;
@@ -626,11 +772,12 @@ bool retro_load_game(const struct retro_game_info *info)
    memset(joypad_state, 0, sizeof(joypad_state));
    memset(keyb_state, 0, sizeof(keyb_state));
    hard_width = hard_height = soft_width = soft_height = 0;
-   select_pressed = keyb_overlay = 0;
+   select_pressed = keyb_overlay = overlay_active = 0;
    keyb_x = keyb_y = 0;
    keyb_send = 0;
    snapshot_buffer = NULL;
-   snapshot_size = 0;
+   snapshot_size = snapshot_length = 0;
+   serialize_machine = NULL;
 
    char *argv[] = {
       "fuse",
@@ -761,163 +908,397 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
    info->geometry.max_height = MAX_HEIGHT;
    info->geometry.aspect_ratio = 0.0f;
    info->timing.fps = machine->id == LIBSPECTRUM_MACHINE_48_NTSC ? 60.0 : 50.0;
-   info->timing.sample_rate = 44100.0;
+   info->timing.sample_rate = settings_current.sound_freq;
 }
 
-static void render_video(void)
+// Gets the frontend's framebuffer if it has one the picture can be put in
+static int get_framebuffer(struct retro_framebuffer* fb)
 {
-   if (!keyb_overlay)
+   fb->width = soft_width;
+   fb->height = soft_height;
+   fb->access_flags = RETRO_MEMORY_ACCESS_WRITE;
+
+   return env_cb(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, fb)
+       && fb->format == RETRO_PIXEL_FORMAT_RGB565
+       && fb->pitch % sizeof(uint16_t) == 0
+       && fb->pitch >= soft_width * sizeof(uint16_t);
+}
+
+// Passes the picture in src, a hard_width x hard_height buffer, on to the
+// frontend. Fuse only redraws what has changed, so it always draws into
+// buffers of its own; the frontend's framebuffer holds nothing from earlier
+// frames and is only good until retro_run() returns, so when there is one
+// the whole picture is copied into it
+static void present_video(const uint16_t* src)
+{
+   struct retro_framebuffer fb;
+   unsigned y;
+
+   // Only Fuse's own buffers are passed on: a frame skipped or repeated
+   // later relies on nothing pointing into a framebuffer of the frontend's
+   assert(src == image_buffer || src == image_buffer_2);
+
+   src += first_pixel;
+
+   if (get_framebuffer(&fb))
    {
-      video_cb(show_frame ? image_buffer + first_pixel : NULL, soft_width, soft_height, hard_width * sizeof(uint16_t));
+      uint8_t* dest = (uint8_t*)fb.data;
+
+      for (y = 0; y < soft_height; y++, src += hard_width, dest += fb.pitch)
+      {
+         memcpy(dest, src, soft_width * sizeof(uint16_t));
+      }
+
+      video_cb(fb.data, soft_width, soft_height, fb.pitch);
    }
    else
    {
-      if (show_frame)
+      video_cb(src, soft_width, soft_height, hard_width * sizeof(uint16_t));
+   }
+}
+
+// Composite the keyboard overlay over image_buffer into dest, for the
+// hard_width x hard_height rectangle at (x, y)
+static void composite_overlay(uint16_t* dest, unsigned pitch, unsigned x, unsigned y, unsigned width, unsigned height)
+{
+   // The overlay is 320x240, and doubled up on the Timex machines
+   unsigned shift = machine->is_timex ? 1 : 0;
+   unsigned i, j;
+
+   for (j = y; j < y + height; j++)
+   {
+      const uint16_t* src1 = keyboard_overlay + (j >> shift) * 320;
+      const uint16_t* src2 = image_buffer + j * hard_width;
+      uint16_t* pixel = dest + j * pitch;
+
+      if (keyb_transparent)
       {
-         if (machine->is_timex)
+         for (i = x; i < x + width; i++)
          {
-            const uint16_t* src1 = keyboard_overlay;
-            const uint16_t* src2 = image_buffer;
-            uint16_t* dest = image_buffer_2;
-            int x, y;
-
-            if (keyb_transparent)
-            {
-               for (y = 0; y < 240; y++)
-               {
-                  for (x = 0; x < 320; x++)
-                  {
-                     uint32_t src1_pixel = (*src1++ & 0xe79c) * 3;
-
-                     dest[ 0 ] = (src1_pixel + ( src2[ 0 ] & 0xe79c)) >> 2;
-                     dest[ 1 ] = (src1_pixel + ( src2[ 1 ] & 0xe79c)) >> 2;
-                     dest[ 640 ] = (src1_pixel + ( src2[ 640 ] & 0xe79c)) >> 2;
-                     dest[ 641 ] = (src1_pixel + ( src2[ 641 ] & 0xe79c)) >> 2;
-
-                     src2 += 2;
-                     dest += 2;
-                  }
-
-                  src2 += 640;
-                  dest += 640;
-               }
-            }
-            else
-            {
-               for (y = 0; y < 240; y++)
-               {
-                  for (x = 0; x < 320; x++)
-                  {
-                     uint32_t src1_pixel = *src1++;
-
-                     dest[ 0 ] = src1_pixel;
-                     dest[ 1 ] = src1_pixel;
-                     dest[ 640 ] = src1_pixel;
-                     dest[ 641 ] = src1_pixel;
-
-                     src2 += 2;
-                     dest += 2;
-                  }
-
-                  src2 += 640;
-                  dest += 640;
-               }
-             }
+            uint32_t src1_pixel = src1[i >> shift] & 0xe79c;
+            uint32_t src2_pixel = src2[i] & 0xe79c;
+
+            pixel[i] = (src1_pixel * 3 + src2_pixel) >> 2;
          }
-         else
+      }
+      else
+      {
+         for (i = x; i < x + width; i++)
          {
-            if (keyb_transparent)
-            {
-               const uint16_t* src1 = keyboard_overlay;
-               const uint16_t* src2 = image_buffer;
-               const uint16_t* end = src1 + sizeof(keyboard_overlay) / sizeof(keyboard_overlay[0]);
-               uint16_t* dest = image_buffer_2;
-
-               do
-               {
-                  uint32_t src1_pixel = *src1++ & 0xe79c;
-                  uint32_t src2_pixel = *src2++ & 0xe79c;
-
-                  *dest++ = (src1_pixel * 3 + src2_pixel) >> 2;
-               }
-               while (src1 < end);
-            }
-            else
-            {
-               memcpy(image_buffer_2, keyboard_overlay, sizeof(keyboard_overlay));
-            }
+            pixel[i] = src1[i >> shift];
          }
+      }
+   }
+}
+
+static void render_overlay(void)
+{
+   static unsigned overlay_width;
+   static int overlay_transparent;
+   static unsigned key_x, key_y, key_width, key_height;
+
+   uint16_t* dest = image_buffer_2;
+   unsigned pitch = hard_width;
+   int full, i;
 
-         unsigned x = keyb_positions[keyb_y].x + keyb_x * 24;
-         unsigned y = keyb_positions[keyb_y].y;
-         unsigned width = 23;
+   unsigned x = keyb_positions[keyb_y].x + keyb_x * 24;
+   unsigned y = keyb_positions[keyb_y].y;
+   unsigned width = 23;
 
-         if (keyb_y == 3)
+   if (keyb_y == 3)
+   {
+      if (keyb_x == 8)
+      {
+         width = 24;
+      }
+      else if (keyb_x == 9)
+      {
+         x++;
+         width = 30;
+      }
+   }
+
+   unsigned mult = machine->is_timex ? 2 : 1;
+
+   full = !overlay_active || hard_width != overlay_width ||
+          keyb_transparent != overlay_transparent || dirty_rect_count < 0;
+
+   // Nothing new to show if the same key is highlighted and the screen
+   // under the overlay either hasn't changed or can't be seen
+   if (can_dupe && !full && x * mult == key_x && y * mult == key_y &&
+       width * mult == key_width && (dirty_rect_count == 0 || !keyb_transparent))
+   {
+      video_cb(NULL, soft_width, soft_height, pitch * sizeof(uint16_t));
+      video_stats.dupes++;
+      return;
+   }
+
+   if (full)
+   {
+      composite_overlay(dest, pitch, 0, 0, hard_width, hard_height);
+   }
+   else
+   {
+      // Take the highlight off the last key, and bring what has changed
+      // under a transparent overlay up to date
+      composite_overlay(dest, pitch, key_x, key_y, key_width, key_height);
+
+      if (keyb_transparent)
+      {
+         for (i = 0; i < dirty_rect_count; i++)
          {
-            if (keyb_x == 8)
-            {
-               width = 24;
-            }
-            else if (keyb_x == 9)
-            {
-               x++;
-               width = 30;
-            }
+            composite_overlay(dest, pitch, dirty_rects[i].x, dirty_rects[i].y, dirty_rects[i].w, dirty_rects[i].h);
          }
+      }
+   }
 
-         unsigned mult = machine->is_timex ? 2 : 1;
-         uint16_t* pixel = image_buffer_2 + (y * hard_width + x + 1) * mult;
-         unsigned i, j;
+   overlay_active = 1;
+   overlay_width = hard_width;
+   overlay_transparent = keyb_transparent;
 
-         for (j = mult; j > 0; --j )
-         {
-            for (i = (width - 2) * mult; i > 0; --i)
-            {
-               *pixel = ~*pixel;
-               pixel++;
-            }
+   uint16_t* pixel = dest + (y * pitch + x + 1) * mult;
+   unsigned j;
 
-            pixel += hard_width - (width - 2) * mult;
-         }
+   key_x = x * mult;
+   key_y = y * mult;
+   key_width = width * mult;
+   key_height = 24 * mult;
 
-         pixel -= mult;
+   for (j = mult; j > 0; --j )
+   {
+      for (i = (width - 2) * mult; i > 0; --i)
+      {
+         *pixel = ~*pixel;
+         pixel++;
+      }
 
-         for (j = 22 * mult; j > 0; --j)
-         {
-            for (i = width * mult; i > 0; --i)
-            {
-               *pixel = ~*pixel;
-               pixel++;
-            }
+      pixel += pitch - (width - 2) * mult;
+   }
 
-            pixel += hard_width - width * mult;
-         }
+   pixel -= mult;
 
-         pixel += mult;
+   for (j = 22 * mult; j > 0; --j)
+   {
+      for (i = width * mult; i > 0; --i)
+      {
+         *pixel = ~*pixel;
+         pixel++;
+      }
 
-         for (j = mult; j > 0; --j)
-         {
-            for (i = (width - 2) * mult; i > 0; --i)
-            {
-               *pixel = ~*pixel;
-               pixel++;
-            }
+      pixel += pitch - width * mult;
+   }
 
-            pixel += hard_width - (width - 2) * mult;
-         }
+   pixel += mult;
 
-         video_cb(image_buffer_2 + first_pixel, soft_width, soft_height, hard_width * sizeof(uint16_t));
+   for (j = mult; j > 0; --j)
+   {
+      for (i = (width - 2) * mult; i > 0; --i)
+      {
+         *pixel = ~*pixel;
+         pixel++;
+      }
+
+      pixel += pitch - (width - 2) * mult;
+   }
+
+   present_video(dest);
+}
+
+static void update_video_stats(void)
+{
+   unsigned long pixels = 0;
+   int i;
+
+   if (dirty_rect_count < 0)
+   {
+      pixels = hard_width * hard_height;
+   }
+   else
+   {
+      for (i = 0; i < dirty_rect_count; i++)
+      {
+         pixels += dirty_rects[i].w * dirty_rects[i].h;
+      }
+   }
+
+   video_stats.frames++;
+   video_stats.rects = dirty_rect_count < 0 ? 1 : dirty_rect_count;
+   video_stats.pixels = pixels;
+   video_stats.total_pixels += pixels;
+   video_stats.screen_pixels = hard_width * hard_height;
+}
+
+static void render_video(void)
+{
+   // Taking the overlay down changes the picture even if the screen under
+   // it hasn't. A frame skipped while fast-forwarding has no dirty
+   // rectangles (uidisplay_area() checks nothing is drawn while the display
+   // is suspended), so it is a dupe, or when the frontend can't take those
+   // the last picture is passed on again by present_video()
+   int changed = dirty_rect_count != 0 || !can_dupe;
+
+   if (!keyb_overlay)
+   {
+      changed |= overlay_active;
+      overlay_active = 0;
+   }
+
+   if (!show_frame)
+   {
+      video_cb(NULL, soft_width, soft_height, hard_width * sizeof(uint16_t));
+      return;
+   }
+
+   update_video_stats();
+
+   if (!keyb_overlay)
+   {
+      if (changed)
+      {
+         present_video(image_buffer);
       }
       else
       {
          video_cb(NULL, soft_width, soft_height, hard_width * sizeof(uint16_t));
+         video_stats.dupes++;
       }
    }
+   else
+   {
+      render_overlay();
+   }
+}
+
+// Run-ahead: once the frame which counts has been run, keep going with the
+// sound off for fuse_run_ahead more and show the last of those instead, so
+// the picture responds to the input that much sooner, then put the machine
+// back. Only possible while the native savestates are
+static int run_ahead_frames(void)
+{
+   int i;
+
+   if (!rollback_ready)
+   {
+      if (rollback_init(1))
+      {
+         return 0;
+      }
+
+      rollback_ready = 1;
+   }
+
+   if (rollback_save())
+   {
+      return 0;
+   }
+
+   sound_suspended = 1;
+
+   for (i = 0; i < run_ahead; i++)
+   {
+      show_frame = 0;
+
+      do {
+         PERF_START(z80_do_opcodes);
+         z80_do_opcodes();
+         PERF_STOP(z80_do_opcodes);
+
+         PERF_START(event_do_events);
+         event_do_events();
+         PERF_STOP(event_do_events);
+      }
+      while (!show_frame);
+   }
+
+   return 1;
+}
+
+static void run_ahead_end(void)
+{
+   // Still silent, as putting the AY back writes to its registers
+   rollback_restore(0);
+   sound_suspended = 0;
+}
+
+// Fast-forwarding: no sound is made at all, and only one frame in every
+// fuse_fast_forward_skip + 1 is drawn. The ones in between are still
+// emulated in full, Fuse just remembers what it would have drawn and
+// catches up in the next one shown. render_video() never hands the
+// frontend anything but Fuse's own buffers, so this needs no framebuffer
+// of the frontend's to stay valid
+static void fast_forward_frame(void)
+{
+   bool frontend_fast_forwarding = false;
+
+   if (fast_forward_skip && env_cb(RETRO_ENVIRONMENT_GET_FASTFORWARDING, &frontend_fast_forwarding) && frontend_fast_forwarding)
+   {
+      fast_forwarding = 1;
+      sound_suspended = 1;
+
+      display_suspended = frames_skipped < fast_forward_skip;
+      frames_skipped = display_suspended ? frames_skipped + 1 : 0;
+   }
+   else if (fast_forwarding)
+   {
+      fast_forwarding = 0;
+      sound_suspended = display_suspended = 0;
+      frames_skipped = 0;
+
+      // The AY's registers carried on changing while the sound was off
+      ay_sound_refresh();
+   }
+}
+
+// Tape turbo: while a tape is playing, spend up to fuse_tape_turbo running
+// frames which aren't drawn and make no sound before the one which is, so
+// loaders Fuse can't trap or accelerate finish that many times sooner. Fuse
+// stops the tape itself once the loader is done with it
+static void tape_turbo_frames(void)
+{
+   int sound_was_suspended = sound_suspended;
+   int display_was_suspended = display_suspended;
+   retro_time_t start;
+
+   if (!tape_turbo_budget || !get_time_usec || !tape_is_playing())
+   {
+      return;
+   }
+
+   start = get_time_usec();
+   sound_suspended = display_suspended = 1;
+
+   do {
+      show_frame = 0;
+
+      do {
+         input_poll_cb();
+
+         PERF_START(z80_do_opcodes);
+         z80_do_opcodes();
+         PERF_STOP(z80_do_opcodes);
+
+         PERF_START(event_do_events);
+         event_do_events();
+         PERF_STOP(event_do_events);
+      }
+      while (!show_frame);
+   }
+   while (tape_is_playing() && get_time_usec() - start < tape_turbo_budget);
+
+   show_frame = 0;
+   sound_suspended = sound_was_suspended;
+   display_suspended = display_was_suspended;
+
+   if (!sound_suspended)
+   {
+      ay_sound_refresh();
+   }
 }
 
 void retro_run(void)
 {
    bool updated = false;
+   int rewinding, ran_ahead;
 
    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
    {
@@ -944,16 +1325,40 @@ void retro_run(void)
          geometry.aspect_ratio = 0.0f;
 
          env_cb(RETRO_ENVIRONMENT_SET_GEOMETRY, &geometry);
+
+         // Make sure the next frame isn't passed on as a duplicate
+         display_refresh_all();
       }
 
       if (flags & UPDATE_MACHINE)
       {
          machine_select( machine->id );
       }
+
+      if (flags & UPDATE_SOUND)
+      {
+         // Start the sound again so the buffers are sized for the new rate,
+         // and the sound thread is started or stopped
+         sound_pause();
+         sound_unpause();
+      }
    }
 
    total_time_ms += frame_time;
    show_frame = some_audio = 0;
+   dirty_rect_count = 0;
+
+   fast_forward_frame();
+
+   // Holding the rewind control steps back through the rewind history,
+   // showing the frame which followed each capture in turn
+   input_poll_cb();
+   rewinding = rewind_device != RETRO_DEVICE_NONE && input_state_cb(0, rewind_device, 0, rewind_id) && !rewind_step_back();
+
+   if (!rewinding)
+   {
+      tape_turbo_frames();
+   }
 
    /*
    After playing Sabre Wulf's initial title music, fuse starts generating
@@ -968,12 +1373,34 @@ void retro_run(void)
    */
    do {
       input_poll_cb();
+
+      PERF_START(z80_do_opcodes);
       z80_do_opcodes();
+      PERF_STOP(z80_do_opcodes);
+
+      PERF_START(event_do_events);
       event_do_events();
+      PERF_STOP(event_do_events);
+   }
+   while (fast_forwarding ? !show_frame : !some_audio);
+
+   if (rewind_budget && !rewinding)
+   {
+      PERF_START(rewind_capture);
+      rewind_capture();
+      PERF_STOP(rewind_capture);
    }
-   while (!some_audio);
 
+   ran_ahead = run_ahead && !rewinding && !fast_forwarding && run_ahead_frames();
+
+   PERF_START(render_video);
    render_video();
+   PERF_STOP(render_video);
+
+   if (ran_ahead)
+   {
+      run_ahead_end();
+   }
 }
 
 void retro_deinit(void)
@@ -1045,30 +1472,74 @@ void retro_reset(void)
    fuse_emulation_unpause();
 }
 
+// The frontend sizes its buffers from the first retro_serialize_size() it
+// gets, but whether the native format can be used changes from frame to
+// frame (not while the disk controller is busy, for one), so the size
+// reported is the larger of the two formats' for the machine. The SZX
+// format only changes size when the machine or its peripherals do, which
+// needs the content loading again
 size_t retro_serialize_size(void)
 {
-   fuse_emulation_pause();
-   snapshot_write("dummy.szx"); // filename is only used to get the snapshot type
-   fuse_emulation_unpause();
-   return snapshot_size;
+   if (machine_current != serialize_machine)
+   {
+      fuse_emulation_pause();
+      snapshot_write("dummy.szx"); // filename is only used to get the snapshot type
+      fuse_emulation_unpause();
+
+      serialize_size = state_size();
+
+      if (serialize_size < snapshot_length)
+         serialize_size = snapshot_length;
+
+      serialize_machine = machine_current;
+   }
+
+   return serialize_size;
 }
 
 bool retro_serialize(void *data, size_t size)
 {
-   bool res = false;
+   // Native states only copy the RAM that has been written to; anything the
+   // native format can't represent goes through SZX
+   if (state_available())
+      return state_write(data, size) == 0;
+
+   fuse_emulation_pause();
+   snapshot_write("dummy.szx");
+   fuse_emulation_unpause();
 
-   if (size <= snapshot_size)
+   if (size < snapshot_length)
    {
-      memcpy(data, snapshot_buffer, snapshot_size);
-      res = true;
+      log_cb(RETRO_LOG_ERROR, "SZX state is %lu bytes, more than the %lu available\n",
+             (unsigned long)snapshot_length, (unsigned long)size);
+      return false;
    }
 
-   return res;
+   memcpy(data, snapshot_buffer, snapshot_length);
+   memset((uint8_t*)data + snapshot_length, 0, size - snapshot_length);
+   return true;
+}
+
+// SZX states are padded with zeroes to the size the frontend asked for, and
+// no chunk has an id of zero, so the snapshot ends at the first one that does
+static size_t szx_length(const uint8_t* data, size_t size)
+{
+   static const uint8_t padding[4] = { 0, 0, 0, 0 };
+   size_t pos = 8; // the file header
+
+   while (pos + 8 <= size && memcmp(data + pos, padding, 4))
+      pos += 8 + (data[pos + 4] | data[pos + 5] << 8 | data[pos + 6] << 16 |
+                  (size_t)data[pos + 7] << 24);
+
+   return pos < size ? pos : size;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
-   return snapshot_read_buffer(data, size, LIBSPECTRUM_ID_SNAPSHOT_SZX) == 0;
+   if (state_identify(data, size))
+      return state_read(data, size) == 0;
+
+   return snapshot_read_buffer(data, szx_length(data, size), LIBSPECTRUM_ID_SNAPSHOT_SZX) == 0;
 }
 
 void retro_cheat_reset(void)
@@ -1081,7 +1552,10 @@ void retro_cheat_reset(void)
       if (cheat->poke.bank == 8)
          writebyte_internal(cheat->poke.address, cheat->poke.restore);
       else
+      {
          RAM[cheat->poke.bank][cheat->poke.address & 0x3fff] = cheat->poke.restore;
+         memory_ram_set_dirty(cheat->poke.bank, cheat->poke.address);
+      }
       
       next = cheat->next;
       free((void*)cheat);
@@ -1154,6 +1628,7 @@ void retro_cheat_set(unsigned index, bool b, const char* code)
                original = RAM[ bank ][ address ];
             
             RAM[bank][address & 0x3fff] = value;
+            memory_ram_set_dirty(bank, address);
          }
 
          cheat->poke.bank = bank;
@@ -1186,9 +1661,22 @@ void retro_unload_game(void)
 {
    free(snapshot_buffer);
    snapshot_buffer = NULL;
-   snapshot_size = 0;
+   snapshot_size = snapshot_length = 0;
    
    free(tape_data);
+
+   if (rollback_ready)
+   {
+      rollback_end();
+      rollback_ready = 0;
+   }
+
+   rewind_end();
+   rewind_budget = 0;
+   rewind_device = RETRO_DEVICE_NONE;
+
+   fast_forwarding = frames_skipped = 0;
+   sound_suspended = display_suspended = 0;
 }
 
 unsigned retro_get_region(void)
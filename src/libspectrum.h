@@ -1172,6 +1172,19 @@ libspectrum_tape_position( int *n, libspectrum_tape *tape );
 WIN32_DLL libspectrum_error
 libspectrum_tape_nth_block( libspectrum_tape *tape, int n );
 
+/* Opaque copies of the playback position; only valid for the same tape
+   object within the same process */
+WIN32_DLL size_t
+libspectrum_tape_position_state_length( void );
+
+WIN32_DLL void
+libspectrum_tape_position_state_get( libspectrum_tape *tape,
+                                     libspectrum_byte *buffer );
+
+WIN32_DLL void
+libspectrum_tape_position_state_set( libspectrum_tape *tape,
+                                     const libspectrum_byte *buffer );
+
 /* Append a block to the current tape */
 WIN32_DLL void
 libspectrum_tape_append_block( libspectrum_tape *tape,
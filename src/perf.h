@@ -0,0 +1,42 @@
+#ifndef PERF_H
+#define PERF_H
+
+// Performance counters for the main subsystems, reported through the
+// frontend's perf interface (RETRO_ENVIRONMENT_GET_PERF_INTERFACE) when the
+// core is built with LOG_PERFORMANCE. They cost nothing otherwise, and only
+// a test for a NULL pointer if the frontend doesn't provide the interface.
+
+#ifdef LOG_PERFORMANCE
+
+#include <libretro.h>
+
+extern struct retro_perf_callback perf_cb;
+
+#define PERF_COUNTER(name) \
+   static struct retro_perf_counter perf_ ## name = { #name }
+
+#define PERF_START(name) \
+   do { \
+      if (perf_cb.perf_start) \
+      { \
+         if (!perf_ ## name.registered) \
+            perf_cb.perf_register(&perf_ ## name); \
+         perf_cb.perf_start(&perf_ ## name); \
+      } \
+   } while (0)
+
+#define PERF_STOP(name) \
+   do { \
+      if (perf_cb.perf_stop) \
+         perf_cb.perf_stop(&perf_ ## name); \
+   } while (0)
+
+#else
+
+#define PERF_COUNTER(name) struct perf_unused_ ## name
+#define PERF_START(name) do {} while (0)
+#define PERF_STOP(name) do {} while (0)
+
+#endif
+
+#endif /* PERF_H */
@@ -0,0 +1,13 @@
+const char* fuse_gitstamp =
+  "+------------------------------------------+\n"
+  "|              FUSE-LIBRETRO               |\n"
+  "|    ____    _   _   ___   _      ____     |\n"
+  "|   | __ )  | | | | |_ _| | |    |  _ \\    |\n"
+  "|   |  _ \\  | | | |  | |  | |    | | | |   |\n"
+  "|   | |_) | | |_| |  | |  | |__  | |_| |   |\n"
+  "|   |____/   \\___/  |___| |____| |____/    |\n"
+  "|                                          |\n"
+  "| 8f4455c5c9f58c4d8db6766773e41d7254d10498 |\n"
+  "+------------------------------------------+\n";
+
+const char* fuse_githash = "8f4455c5c9f58c4d8db6766773e41d7254d10498";